@@ -0,0 +1,299 @@
+#include "world.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <vector>
+
+// Micro/macro benchmarks for the simulation hot paths. Every case reports ns/op and heap allocations/op.
+// Usage: bench [--map WIDTHxHEIGHT] [building count ...]   (default: 10 1000 100000), then 10k and 100k enemies
+// and 1k and 60k projectiles, then a 500-tile area placement and a 10k-building logistics layout, joined and split
+// Without --map, each case gets the smallest square map (at least 40x40) its layout fits on.
+
+static long long allocations = 0;
+
+void *operator new(std::size_t size) {
+	allocations++;
+	if (void *p = malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+
+template <typename Fn>
+static void Bench(const char *name, int count, long long ops, Fn fn) {
+	long long allocsBefore = allocations;
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	double allocs = (double)(allocations - allocsBefore) / ops;
+	printf("%-28s %8d %12.1f ns/op %10.2f allocs/op\n", name, count, ns / ops, allocs);
+}
+
+// Walks outward from the map centre and fills tiles with a base, a transporter on every third tile and
+// consumers in between, until `count` buildings stand or the map is full.
+static std::vector<Building> SyntheticLayout(World &world, int count) {
+	const BuildingType consumers[3] = {BUILD_ARCHER, BUILD_FACTORY, BUILD_CANNON};
+	std::vector<Building> placed;
+	int cx = world.width / 2, cy = world.height / 2;
+	int n = 0;
+	for (int r = 0; r < std::max(world.width, world.height) && (int)placed.size() < count; r++)
+		for (int y = cy - r; y <= cy + r && (int)placed.size() < count; y++)
+			for (int x = cx - r; x <= cx + r && (int)placed.size() < count; x++) {
+				if (std::max(abs(x - cx), abs(y - cy)) != r) continue;
+				BuildingType type = !world.basePlaced ? BUILD_BASE : (n % 3 == 0 ? BUILD_TRANSPORTER : consumers[n % 9 / 3]);
+				if (world.Place(type, x, y)) {
+					placed.push_back({type, x, y});
+					n++;
+				}
+			}
+	return placed;
+}
+
+static void RunCase(int requested, int width, int height) {
+	if (width <= 0) {
+		// Resources and their isolation margins take roughly a tenth of the map.
+		width = height = std::max(defaultMapWidth, (int)ceil(sqrt(requested * 1.2)));
+	}
+	World world(width, height);
+	world.NewGame();
+	std::vector<Building> layout = SyntheticLayout(world, requested);
+	int count = layout.size();
+	printf("-- %dx%d map, %d buildings\n", width, height, count);
+
+	Bench("layout from scratch", count, count, [&] {
+		World fresh(width, height);
+		fresh.NewGame();
+		SyntheticLayout(fresh, requested);
+	});
+
+	// Remove and re-place one transporter in the middle of the network: the incremental connectivity update.
+	const Building *hub = nullptr;
+	for (auto &b : layout)
+		if (b.type == BUILD_TRANSPORTER) {
+			hub = &b;
+			break;
+		}
+	if (hub) {
+		const int reps = 2000;
+		Bench("connectivity remove+place", count, reps, [&] {
+			for (int i = 0; i < reps; i++) {
+				world.Remove(hub->x, hub->y);
+				world.Place(BUILD_TRANSPORTER, hub->x, hub->y);
+			}
+		});
+	}
+
+	if (hub) {
+		const int reps = 200;
+		Bench("flow field remove+place", count, reps, [&] {
+			for (int i = 0; i < reps; i++) {
+				world.Remove(hub->x, hub->y);
+				world.flowField.Update();
+				world.Place(BUILD_TRANSPORTER, hub->x, hub->y);
+				world.flowField.Update();
+			}
+		});
+	}
+
+	if (world.basePlaced) {
+		const int reps = 5;
+		Bench("flow field rebuild", width * height, reps, [&] {
+			for (int i = 0; i < reps; i++) world.flowField.Build(world.flowField.Target());
+		});
+	}
+
+	{
+		const int reps = 200;
+		// Stays in daylight, so no waves spawn and only the economy runs.
+		Bench("resource tick", count, reps, [&] {
+			for (int i = 0; i < reps; i++) {
+				world.gameTime = 12.0f;
+				world.Tick(1.0f);
+			}
+		});
+	}
+
+	{
+		const int reps = 200;
+		// Fifteen daylight hours with nothing moving run as a single step with a batched economy.
+		Bench("fast-forward 15h", count, reps, [&] {
+			for (int i = 0; i < reps; i++) {
+				world.gameTime = 7.0f;
+				world.Advance(15.0f);
+			}
+		});
+	}
+
+	{
+		const int reps = 1000000;
+		int valid = 0;
+		Bench("placement validation", count, reps, [&] {
+			for (int i = 0; i < reps; i++) {
+				int tile = (long long)i * 7919 % (width * height);
+				valid += world.CanPlace(BUILD_TRANSPORTER, tile % width, tile / width);
+			}
+		});
+		if (valid < 0) printf("%d\n", valid);
+	}
+
+	{
+		const int reps = 5;
+		World fresh(width, height);
+		Bench("resource generation", width * height, reps, [&] {
+			for (int i = 0; i < reps; i++) fresh.NewGame(i);
+		});
+	}
+
+	// CPU side of the render passes: walking the cached power-line list and the building list into
+	// screen-space vertices, as main.cpp does every frame. Draw calls themselves need a window.
+	{
+		const int reps = 1000;
+		float sink = 0.0f;
+		Bench("connection line pass", count, reps, [&] {
+			for (int i = 0; i < reps; i++)
+				for (auto &e : world.powerGrid.Edges())
+					sink += (e.first % width) * 64.0f + (e.second / width) * 64.0f;
+		});
+		Bench("building draw pass", count, reps, [&] {
+			const BuildingIndex &index = world.index;
+			for (int i = 0; i < reps; i++)
+				for (size_t b = 0; b < index.buildings.size(); b++)
+					sink += index.buildings[b].x * 64.0f + index.buildings[b].y * 64.0f + index.powered[b];
+		});
+		if (sink < 0.0f) printf("%f\n", sink);
+	}
+}
+
+// Units scattered around a defended base in the map centre, walking toward it. They are too slow and too
+// tough to arrive or die during the run, so every tick moves, buckets and checks all of them, and every
+// powered archer and cannon picks a target among those in range.
+static void RunEnemyCase(int units) {
+	World world(256, 256);
+	world.NewGame(1);
+	int towers = 0;
+	for (auto &b : SyntheticLayout(world, 2000)) towers += b.type == BUILD_ARCHER || b.type == BUILD_CANNON;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f), radius(5.0f, 40.0f);
+	for (int i = 0; i < units; i++) {
+		float a = angle(rng), r = radius(rng);
+		world.enemies.Spawn(128 + r * cosf(a), 128 + r * sinf(a), 1e9f, 0.01f, 1.0f);
+	}
+	const int reps = 600;
+	printf("-- %d enemies, %d towers\n", units, towers);
+	Bench("enemy tick", units, (long long)reps * units, [&] {
+		for (int i = 0; i < reps; i++) world.Tick(World::fixedStep);
+	});
+	if ((int)world.enemies.Count() != units) printf("lost %d enemies\n", units - (int)world.enemies.Count());
+	printf("%zu projectiles peak\n", world.projectiles.Peak());
+}
+
+// Keeps `shots` projectiles in flight, relaunching each one as it lands.
+static void RunProjectileCase(int shots) {
+	static Projectiles pool;
+	pool.Clear();
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> coord(0.0f, 256.0f);
+	for (int i = 0; i < shots; i++) pool.Spawn(PROJECTILE_ARROW, coord(rng), coord(rng), coord(rng), coord(rng), 12.0f);
+	const int reps = 600;
+	int landed = 0;
+	printf("-- %d projectiles\n", shots);
+	Bench("projectile update", shots, (long long)reps * shots, [&] {
+		for (int i = 0; i < reps; i++) {
+			pool.Advance(World::fixedStep, [&](ProjectileKind, float, float) { landed++; });
+			while ((int)pool.Live() < shots) pool.Spawn(PROJECTILE_ARROW, coord(rng), coord(rng), coord(rng), coord(rng), 12.0f);
+		}
+	});
+	printf("%d landed\n", landed);
+}
+
+// A 25x20 block of transporters next to the base, built and torn down one by one and as one area batch.
+static void RunAreaCase() {
+	World world(256, 256);
+	world.NewGame(1);
+	for (int r = 0; r < 128 && !world.basePlaced; r++) world.Place(BUILD_BASE, 128 + r, 128);
+	int x0 = world.baseX + 2, y0 = world.baseY - 10, x1 = x0 + 24, y1 = y0 + 19;
+	const int reps = 20;
+	int placed = 0;
+	printf("-- 500-tile block\n");
+	Bench("place+remove one by one", 500, reps, [&] {
+		for (int i = 0; i < reps; i++) {
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++) placed += world.Place(BUILD_TRANSPORTER, x, y);
+			for (int y = y0; y <= y1; y++)
+				for (int x = x0; x <= x1; x++) world.Remove(x, y);
+		}
+	});
+	Bench("place+remove area", 500, reps, [&] {
+		for (int i = 0; i < reps; i++) {
+			placed += world.PlaceArea(BUILD_TRANSPORTER, x0, y0, x1, y1);
+			world.RemoveArea(x0, y0, x1, y1);
+		}
+	});
+	printf("%d placed\n", placed);
+}
+
+// A grid of transporter lines fed by gold mines, with factories and cannons in between and a base every
+// 16 tiles, either all joined into one network or, without the transporters near the lines between the
+// 16-tile blocks, split into one network per base. A change of buildings re-solves the network it is in, ticking every hour.
+static void RunLogisticsCase(int nodes, bool joined) {
+	// Transporters further than linkRange from every line between blocks, so that no two blocks link.
+	auto Inside = [](int v) { return v % 16 >= 3 && v % 16 <= 13; };
+	int side = (int)ceil(sqrt(nodes * 1.6));
+	World world(side, side);
+	world.Place(BUILD_BASE, side / 2 / 16 * 16 + 8, side / 2 / 16 * 16 + 8);
+	for (int y = 0; y < side; y++)
+		for (int x = 0; x < side; x++) {
+			if (x % 4 == 2 && y % 4 == 2 && x + 1 < side) {
+				world.tiles[world.PosToIndex(x, y)] = 2;
+				world.Place(BUILD_GOLD_MINE, x + 1, y);
+			}
+			if (x % 16 == 8 && y % 16 == 8) world.Place(BUILD_BASE, x, y);
+			else if ((x % 4 == 0 || y % 4 == 0) && (joined || (Inside(x) && Inside(y)))) world.Place(BUILD_TRANSPORTER, x, y);
+			else if (x % 4 == 1 && y % 4 == 2) world.Place(BUILD_FACTORY, x, y);
+			else if (x % 4 == 2 && y % 4 == 1) world.Place(BUILD_CANNON, x, y);
+		}
+	int count = world.Buildings().size();
+	world.gameTime = 12.0f;
+	world.Tick(1.0f);
+	int networks = 0;
+	for (const Network &network : world.networks) networks += network.stock >= 0;
+	printf("-- %d buildings, %d networks\n", count, networks);
+	const int reps = 20;
+	Bench("logistics re-solve", count, reps, [&] {
+		for (int i = 0; i < reps; i++) {
+			world.Remove(4, 4);
+			world.Place(BUILD_TRANSPORTER, 4, 4);
+			world.gameTime = 12.0f;
+			world.Tick(1.0f);
+		}
+	});
+	const int ticks = 1000;
+	Bench("logistics tick", count, ticks, [&] {
+		for (int i = 0; i < ticks; i++) {
+			world.gameTime = 12.0f;
+			world.Tick(1.0f);
+		}
+	});
+}
+
+int main(int argc, char **argv) {
+	std::vector<int> counts;
+	int width = 0, height = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) sscanf(argv[++i], "%dx%d", &width, &height);
+		else counts.push_back(atoi(argv[i]));
+	}
+	if (counts.empty()) counts = {10, 1000, 100000};
+	printf("%-28s %8s %15s %20s\n", "case", "n", "time", "allocations");
+	for (int count : counts) RunCase(count, width, height);
+	for (int units : {10000, 100000}) RunEnemyCase(units);
+	for (int shots : {1000, 60000}) RunProjectileCase(shots);
+	RunAreaCase();
+	RunLogisticsCase(10000, true);
+	RunLogisticsCase(10000, false);
+	return 0;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <cstddef>
+
+// Little helpers for the binary save and replay formats: values are stored as raw native-endian bytes.
+
+template <typename T>
+inline void Put(std::vector<unsigned char> &out, T value) {
+	unsigned char raw[sizeof(T)];
+	memcpy(raw, &value, sizeof(T));
+	out.insert(out.end(), raw, raw + sizeof(T));
+}
+
+template <typename T>
+inline bool Get(const std::vector<unsigned char> &in, size_t &pos, T &value) {
+	if (pos + sizeof(T) > in.size()) return false;
+	memcpy(&value, in.data() + pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
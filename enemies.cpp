@@ -0,0 +1,80 @@
+#include "enemies.h"
+#include <cmath>
+#include <algorithm>
+
+void Enemies::Clear() {
+	x.clear();
+	y.clear();
+	health.clear();
+	speed.clear();
+	damage.clear();
+}
+
+void Enemies::Spawn(float posX, float posY, float hp, float tilesPerHour, float hits) {
+	x.push_back(posX);
+	y.push_back(posY);
+	health.push_back(hp);
+	speed.push_back(tilesPerHour);
+	damage.push_back(hits);
+}
+
+void Enemies::Remove(size_t i) {
+	size_t last = x.size() - 1;
+	x[i] = x[last];
+	y[i] = y[last];
+	health[i] = health[last];
+	speed[i] = speed[last];
+	damage[i] = damage[last];
+	x.pop_back();
+	y.pop_back();
+	health.pop_back();
+	speed.pop_back();
+	damage.pop_back();
+}
+
+// Steps every unit toward its goal, at most onto it. Branch-free so that it vectorizes with the flags in
+// the README.
+void Enemies::Move(float dt) {
+	size_t n = x.size();
+	float *px = x.data(), *py = y.data();
+	const float *ps = speed.data(), *gx = goalX.data(), *gy = goalY.data();
+	for (size_t i = 0; i < n; i++) {
+		float dx = gx[i] - px[i], dy = gy[i] - py[i];
+		float dist = std::sqrt(dx * dx + dy * dy);
+		float t = std::min(ps[i] * dt / std::max(dist, 1e-6f), 1.0f);
+		px[i] += dx * t;
+		py[i] += dy * t;
+	}
+}
+
+float Enemies::Cull(float targetX, float targetY, float radius) {
+	float hits = 0.0f;
+	// Walking backwards, the unit swapped into slot i has already been checked.
+	for (size_t i = x.size(); i-- > 0;) {
+		float dx = targetX - x[i], dy = targetY - y[i];
+		bool arrived = dx * dx + dy * dy <= radius * radius;
+		if (!arrived && health[i] > 0.0f) continue;
+		if (arrived && health[i] > 0.0f) hits += damage[i];
+		Remove(i);
+	}
+	return hits;
+}
+
+void EnemyGrid::Build(const Enemies &enemies, int mapWidth, int mapHeight) {
+	// Units spawn on the far map edge, one past the last tile; the clamp in CellX/CellY keeps them in range.
+	cols = (int)std::ceil(mapWidth / cellSize);
+	rows = (int)std::ceil(mapHeight / cellSize);
+	size_t n = enemies.Count();
+	cellStart.assign(cols * rows + 1, 0);
+	cellOf.resize(n);
+	order.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		cellOf[i] = CellY(enemies.y[i]) * cols + CellX(enemies.x[i]);
+		cellStart[cellOf[i] + 1]++;
+	}
+	for (int c = 0; c < cols * rows; c++) cellStart[c + 1] += cellStart[c];
+	// Scatter using cellStart as the write cursor, then shift it back to the cell starts.
+	for (size_t i = 0; i < n; i++) order[cellStart[cellOf[i]]++] = i;
+	for (int c = cols * rows; c > 0; c--) cellStart[c] = cellStart[c - 1];
+	cellStart[0] = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+
+// Attacking units as parallel arrays, one entry per unit, kept compact with swap-remove. Positions are in
+// tiles (a unit at 2.5, 3.5 stands in the middle of tile 2, 3), speed in tiles per game hour.
+struct Enemies {
+	std::vector<float> x, y;
+	std::vector<float> health;
+	std::vector<float> speed;
+	std::vector<float> damage;
+	// Where each unit is heading this tick, filled by the caller before Move(); not saved.
+	std::vector<float> goalX, goalY;
+
+	size_t Count() const { return x.size(); }
+	void Clear();
+	void Spawn(float posX, float posY, float hp, float tilesPerHour, float hits);
+	void Remove(size_t i);
+	// Moves every unit `dt` game hours straight toward its goal, stopping on it.
+	void Move(float dt);
+	// Despawns dead units and units within `radius` of the target; returns the damage the arrivals deal.
+	float Cull(float targetX, float targetY, float radius);
+};
+
+// Enemy indices bucketed into square cells, rebuilt from scratch every tick with a counting sort into
+// flat arrays that keep their capacity, so rebuilding does not allocate once the arrays have grown.
+struct EnemyGrid {
+	static constexpr float cellSize = 4.0f;
+
+	void Build(const Enemies &enemies, int mapWidth, int mapHeight);
+
+	// Calls fn(i) for every enemy within `range` of (x, y).
+	template <typename Fn>
+	void ForEachInRange(const Enemies &enemies, float x, float y, float range, Fn fn) const {
+		int cx0 = CellX(x - range), cx1 = CellX(x + range), cy0 = CellY(y - range), cy1 = CellY(y + range);
+		for (int cy = cy0; cy <= cy1; cy++)
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int cell = cy * cols + cx;
+				for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+					int i = order[k];
+					float dx = enemies.x[i] - x, dy = enemies.y[i] - y;
+					if (dx * dx + dy * dy <= range * range) fn(i);
+				}
+			}
+	}
+
+private:
+	int cols = 0, rows = 0;
+	std::vector<int> cellStart;
+	std::vector<int> cellOf;
+	std::vector<int> order;
+
+	int CellX(float x) const { return std::clamp((int)std::floor(x / cellSize), 0, cols - 1); }
+	int CellY(float y) const { return std::clamp((int)std::floor(y / cellSize), 0, rows - 1); }
+};
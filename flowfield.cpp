@@ -0,0 +1,161 @@
+#include "flowfield.h"
+#include "profiler.h"
+#include <algorithm>
+#include <functional>
+
+// Past this many queued changes per tile of the map, Update() rebuilds the whole field.
+static const size_t rebuildFraction = 64;
+// An update gives up and rebuilds once it has pushed as many heap entries as Build() does, one per tile, or
+// once a raised cost has cut more than this fraction of the tiles off their paths: finding and refilling
+// that many tiles already costs about as much as a rebuild.
+static const size_t lostFraction = 3;
+
+void FlowField::Reset(int mapWidth, int mapHeight) {
+	width = mapWidth;
+	height = mapHeight;
+	target = -1;
+	cost.assign(width * height, 1);
+	wanted.assign(width * height, 1);
+	pending.clear();
+	dist.assign(width * height, unreachable);
+	mark.assign(width * height, 0);
+}
+
+template <typename Fn>
+void FlowField::ForEachNeighbour(int tile, Fn fn) const {
+	int x = tile % width;
+	if (x > 0) fn(tile - 1);
+	if (x < width - 1) fn(tile + 1);
+	if (tile >= width) fn(tile - width);
+	if (tile < (height - 1) * width) fn(tile + width);
+}
+
+void FlowField::Build(int targetTile) {
+	PROFILE_SCOPE("flow field");
+	target = targetTile;
+	cost = wanted;
+	pending.clear();
+	std::fill(dist.begin(), dist.end(), unreachable);
+	heap.clear();
+	work = 0;
+	workBudget = SIZE_MAX;
+	Offer(target, 0);
+	Relax();
+}
+
+void FlowField::SetCost(int tile, int newCost) {
+	if (wanted[tile] == newCost) return;
+	wanted[tile] = newCost;
+	pending.push_back(tile);
+}
+
+void FlowField::Update() {
+	if (target < 0 || pending.empty()) return;
+	if (pending.size() * rebuildFraction > cost.size()) {
+		Build(target);
+		return;
+	}
+	PROFILE_SCOPE("flow field");
+	work = 0;
+	workBudget = cost.size();
+	for (int tile : pending)
+		if (!Apply(tile, wanted[tile])) {
+			Build(target);
+			return;
+		}
+	pending.clear();
+}
+
+// Raising a cost can only lengthen paths through the tile. Tiles that depended on it are found in order of
+// distance: one keeps its distance if some neighbour outside the lost region still supports it, otherwise it
+// is lost too. Lost tiles are then refilled from the untouched tiles around them. Lowering a cost can only
+// shorten paths, so the tile is offered its new distance and the improvement spreads from there.
+// Returns false, leaving the field to be rebuilt, once the update has done more work than a rebuild would.
+bool FlowField::Apply(int tile, int newCost) {
+	int old = cost[tile];
+	cost[tile] = newCost;
+	if (tile == target || newCost == old) return true;
+	if (newCost < old) {
+		uint32_t best = BestNeighbour(tile);
+		if (best != unreachable) Offer(tile, best + newCost);
+		return Relax();
+	}
+	// mark is 1 on lost tiles and 2 on tiles queued for the support check, so each is queued once.
+	lost.assign(1, tile);
+	mark[tile] = 1;
+	heap.clear();
+	auto pushDependents = [&](int from) {
+		ForEachNeighbour(from, [&](int n) {
+			if (!mark[n] && dist[n] != unreachable && dist[n] == dist[from] + cost[n]) {
+				mark[n] = 2;
+				work++;
+				heap.push_back({dist[n], n});
+				std::push_heap(heap.begin(), heap.end(), std::greater<>());
+			}
+		});
+	};
+	pushDependents(tile);
+	while (!heap.empty()) {
+		if (work > workBudget || lost.size() * lostFraction > cost.size()) {
+			for (int t : lost) mark[t] = 0;
+			for (auto &queued : heap) mark[queued.second] = 0;
+			return false;
+		}
+		std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+		int t = heap.back().second;
+		heap.pop_back();
+		bool supported = false;
+		ForEachNeighbour(t, [&](int n) {
+			if (mark[n] != 1 && dist[n] != unreachable && dist[n] + cost[t] == dist[t]) supported = true;
+		});
+		if (supported) {
+			mark[t] = 0;
+			continue;
+		}
+		mark[t] = 1;
+		lost.push_back(t);
+		pushDependents(t);
+	}
+	for (int t : lost) dist[t] = unreachable;
+	for (int t : lost) {
+		mark[t] = 0;
+		uint32_t best = BestNeighbour(t);
+		if (best != unreachable) Offer(t, best + cost[t]);
+	}
+	return Relax();
+}
+
+int FlowField::Next(int tile) const {
+	int next = tile;
+	if (target < 0) return next;
+	ForEachNeighbour(tile, [&](int n) {
+		if (dist[n] < dist[next]) next = n;
+	});
+	return next;
+}
+
+void FlowField::Offer(int tile, uint32_t d) {
+	if (d >= dist[tile]) return;
+	dist[tile] = d;
+	work++;
+	heap.push_back({d, tile});
+	std::push_heap(heap.begin(), heap.end(), std::greater<>());
+}
+
+uint32_t FlowField::BestNeighbour(int tile) const {
+	uint32_t best = unreachable;
+	ForEachNeighbour(tile, [&](int n) { best = std::min(best, dist[n]); });
+	return best;
+}
+
+bool FlowField::Relax() {
+	while (!heap.empty()) {
+		if (work > workBudget) return false;
+		std::pop_heap(heap.begin(), heap.end(), std::greater<>());
+		auto [d, tile] = heap.back();
+		heap.pop_back();
+		if (d > dist[tile]) continue;
+		ForEachNeighbour(tile, [&](int n) { Offer(n, d + cost[n]); });
+	}
+	return true;
+}
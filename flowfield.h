@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Distance field toward one target tile over a grid of per-tile costs, shared by every unit: a unit on
+// tile t steps to Next(t). Leaving a tile costs that tile's cost.
+//
+// Cost changes are queued and applied by Update(), one at a time, each redoing only the part of the field
+// whose distances depend on the changed tile. A large batch (a load, a wall of buildings placed during the
+// day) can touch most of the map either way, so past a threshold Update() rebuilds from scratch instead; so
+// does an update that turns out to redo a large part of the field, e.g. a building next to the target.
+struct FlowField {
+	static constexpr uint32_t unreachable = UINT32_MAX;
+
+	void Reset(int mapWidth, int mapHeight);
+	// Costs are 1 to 255.
+	void SetCost(int tile, int cost);
+	void Build(int targetTile);
+	void Update();
+
+	int Target() const { return target; }
+	uint32_t Distance(int tile) const { return dist[tile]; }
+	// The neighbour one step closer to the target, or `tile` itself on the target or before Build(). Only
+	// reflects costs up to the last Update().
+	int Next(int tile) const;
+
+private:
+	int width = 0, height = 0;
+	int target = -1;
+	// `cost` is what `dist` was computed with; `wanted` holds the costs set since, listed in `pending`.
+	std::vector<uint8_t> cost, wanted;
+	std::vector<int> pending;
+	std::vector<uint32_t> dist;
+	std::vector<unsigned char> mark;
+	std::vector<int> lost;
+	std::vector<std::pair<uint32_t, int>> heap;
+	// Heap pushes so far in this Update(), and how many it may make before rebuilding instead.
+	size_t work = 0, workBudget = SIZE_MAX;
+
+	template <typename Fn>
+	void ForEachNeighbour(int tile, Fn fn) const;
+	void Offer(int tile, uint32_t d);
+	uint32_t BestNeighbour(int tile) const;
+	bool Relax();
+	bool Apply(int tile, int newCost);
+};
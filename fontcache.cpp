@@ -0,0 +1,137 @@
+#include "fontcache.h"
+#include "bytes.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+const char *fontCachePath = "cache";
+
+namespace {
+
+const char fontCacheMagic[4] = {'D', 'O', 'T', 'F'};
+const uint32_t fontCacheVersion = 1;
+// raylib's default padding around each glyph in the atlas.
+const int glyphPadding = 4;
+
+uint64_t Hash(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+int BytesPerPixel(int format) {
+	switch (format) {
+		case PIXELFORMAT_UNCOMPRESSED_GRAYSCALE: return 1;
+		case PIXELFORMAT_UNCOMPRESSED_GRAY_ALPHA: return 2;
+		case PIXELFORMAT_UNCOMPRESSED_R8G8B8A8: return 4;
+		default: return 0;
+	}
+}
+
+// Glyph images are not cached: drawing only needs the atlas and the metrics.
+bool ReadCache(const std::string &file, uint64_t key, Font &font) {
+	std::ifstream cache(file, std::ios::binary);
+	if (!cache.is_open()) return false;
+	std::vector<unsigned char> in((std::istreambuf_iterator<char>(cache)), std::istreambuf_iterator<char>());
+	size_t pos = 4;
+	uint32_t version;
+	uint64_t savedKey;
+	int32_t size, count, padding, width, height, format;
+	if (in.size() < 4 || memcmp(in.data(), fontCacheMagic, 4) != 0) return false;
+	if (!Get(in, pos, version) || version != fontCacheVersion || !Get(in, pos, savedKey) || savedKey != key) return false;
+	if (!Get(in, pos, size) || !Get(in, pos, count) || !Get(in, pos, padding) || count <= 0) return false;
+	if (!Get(in, pos, width) || !Get(in, pos, height) || !Get(in, pos, format) || width <= 0 || height <= 0) return false;
+	size_t pixelBytes = (size_t)width * height * BytesPerPixel(format);
+	size_t glyphBytes = (size_t)count * (4 * sizeof(int32_t) + 4 * sizeof(float));
+	if (pixelBytes == 0 || pos + pixelBytes + glyphBytes != in.size()) return false;
+	Image atlas = {in.data() + pos, width, height, 1, format};
+	pos += pixelBytes;
+	font.baseSize = size;
+	font.glyphCount = count;
+	font.glyphPadding = padding;
+	font.glyphs = (GlyphInfo *)MemAlloc(count * sizeof(GlyphInfo));
+	font.recs = (Rectangle *)MemAlloc(count * sizeof(Rectangle));
+	for (int i = 0; i < count; i++) {
+		GlyphInfo &glyph = font.glyphs[i];
+		Rectangle &rec = font.recs[i];
+		Get(in, pos, glyph.value);
+		Get(in, pos, glyph.offsetX);
+		Get(in, pos, glyph.offsetY);
+		Get(in, pos, glyph.advanceX);
+		Get(in, pos, rec.x);
+		Get(in, pos, rec.y);
+		Get(in, pos, rec.width);
+		Get(in, pos, rec.height);
+	}
+	font.texture = LoadTextureFromImage(atlas);
+	return true;
+}
+
+// Written to a temporary file that is renamed over the cache, like saves.
+void WriteCache(const std::string &file, uint64_t key, const Font &font, const Image &atlas) {
+	int bytesPerPixel = BytesPerPixel(atlas.format);
+	if (bytesPerPixel == 0) return;
+	std::vector<unsigned char> out(fontCacheMagic, fontCacheMagic + 4);
+	Put<uint32_t>(out, fontCacheVersion);
+	Put<uint64_t>(out, key);
+	Put<int32_t>(out, font.baseSize);
+	Put<int32_t>(out, font.glyphCount);
+	Put<int32_t>(out, font.glyphPadding);
+	Put<int32_t>(out, atlas.width);
+	Put<int32_t>(out, atlas.height);
+	Put<int32_t>(out, atlas.format);
+	const unsigned char *pixels = (const unsigned char *)atlas.data;
+	out.insert(out.end(), pixels, pixels + (size_t)atlas.width * atlas.height * bytesPerPixel);
+	for (int i = 0; i < font.glyphCount; i++) {
+		Put<int32_t>(out, font.glyphs[i].value);
+		Put<int32_t>(out, font.glyphs[i].offsetX);
+		Put<int32_t>(out, font.glyphs[i].offsetY);
+		Put<int32_t>(out, font.glyphs[i].advanceX);
+		Put<float>(out, font.recs[i].x);
+		Put<float>(out, font.recs[i].y);
+		Put<float>(out, font.recs[i].width);
+		Put<float>(out, font.recs[i].height);
+	}
+	std::error_code error;
+	std::filesystem::create_directories(fontCachePath, error);
+	std::string temp = file + ".tmp";
+	{
+		std::ofstream cache(temp, std::ios::binary | std::ios::trunc);
+		if (!cache.write((const char *)out.data(), out.size())) return;
+	}
+	std::filesystem::rename(temp, file, error);
+	if (error) std::filesystem::remove(temp, error);
+}
+
+}
+
+Font LoadFontCached(const char *path, int size, int *codepoints, int count) {
+	int dataSize = 0;
+	unsigned char *data = LoadFileData(path, &dataSize);
+	if (!data) return GetFontDefault();
+	uint64_t key = Hash(14695981039346656037ull, data, dataSize);
+	key = Hash(key, codepoints, count * sizeof(int));
+	key = Hash(key, &size, sizeof(size));
+	std::string name = std::filesystem::path(path).stem().string() + "-" + std::to_string(size) + ".font";
+	std::string file = (std::filesystem::path(fontCachePath) / name).string();
+	Font font = {0};
+	if (ReadCache(file, key, font)) {
+		UnloadFileData(data);
+		return font;
+	}
+	font.baseSize = size;
+	font.glyphCount = count;
+	font.glyphPadding = glyphPadding;
+	font.glyphs = LoadFontData(data, dataSize, size, codepoints, count, FONT_DEFAULT);
+	UnloadFileData(data);
+	if (!font.glyphs) return GetFontDefault();
+	Image atlas = GenImageFontAtlas(font.glyphs, &font.recs, count, size, glyphPadding, 0);
+	font.texture = LoadTextureFromImage(atlas);
+	WriteCache(file, key, font, atlas);
+	UnloadImage(atlas);
+	return font;
+}
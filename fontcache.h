@@ -0,0 +1,11 @@
+#pragma once
+#include "raylib.h"
+
+// Directory the baked atlases are kept in; created on first write.
+extern const char *fontCachePath;
+
+// Loads a TTF font rasterised at `size` pixels for `codepoints`. The baked atlas and glyph metrics are kept
+// on disk under a hash of the font file, the codepoints and the size, so only the first launch after any of
+// them changes pays for rasterising. Without a usable cache it bakes as LoadFontEx would; without the font
+// file it returns raylib's default font.
+Font LoadFontCached(const char *path, int size, int *codepoints, int count);
@@ -0,0 +1,110 @@
+#include "world.h"
+#include "replay.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Runs the simulation without a window and reports how many fixed steps it manages per second.
+// Usage: headless [game seconds to simulate] [time speed] [map width] [map height]
+//        headless --replay FILE    replays a session recorded with `defence --record FILE` as fast as possible
+//        headless --check-save [ROUNDS]    checks that a save loads back into a world that runs on identically
+
+static void PlaceSyntheticBase(World &world) {
+	int cx = world.width / 2, cy = world.height / 2;
+	for (int r = 0; r < std::max(world.width, world.height) && !world.basePlaced; r++)
+		for (int dy = -r; dy <= r && !world.basePlaced; dy++)
+			for (int dx = -r; dx <= r && !world.basePlaced; dx++)
+				world.Place(BUILD_BASE, cx + dx, cy + dy);
+	for (int y = 0; y < world.height; y += 4)
+		for (int x = 0; x < world.width; x += 4)
+			world.Place(BUILD_TRANSPORTER, x, y);
+	const BuildingType producers[3] = {BUILD_SAWMILL, BUILD_GOLD_MINE, BUILD_IRON_MINE};
+	for (int y = 0; y < world.height; y++)
+		for (int x = 0; x < world.width; x++)
+			for (BuildingType type : producers)
+				world.Place(type, x, y);
+	for (int y = 2; y < world.height; y += 8)
+		for (int x = 2; x < world.width; x += 8) {
+			world.Place(BUILD_FACTORY, x, y);
+			world.Place(BUILD_CANNON, x + 1, y);
+			world.Place(BUILD_ARCHER, x, y + 1);
+		}
+}
+
+static int RunReplay(const char *path) {
+	Replay replay;
+	if (!ReadReplay(path, replay)) {
+		fprintf(stderr, "could not read replay %s\n", path);
+		return 1;
+	}
+	World world(1, 1);
+	auto start = std::chrono::steady_clock::now();
+	if (!replay.Run(world)) {
+		fprintf(stderr, "replay %s has an invalid start state\n", path);
+		return 1;
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	uint64_t hash = world.StateHash();
+	printf("commands: %zu, ticks: %llu (%.1f min of play)\n", replay.commands.size(), (unsigned long long)replay.endTick,
+		replay.endTick * World::fixedStep / 60.0);
+	printf("replayed in %.3f s (%.0f ticks/s)\n", elapsed, elapsed > 0 ? replay.endTick / elapsed : 0.0);
+	printf("end state hash %016llx, recorded %016llx: %s\n", (unsigned long long)hash, (unsigned long long)replay.endHash,
+		hash == replay.endHash ? "match" : "MISMATCH");
+	return hash == replay.endHash ? 0 : 2;
+}
+
+// Every round saves the synthetic game, loads the save into a second world and runs both for the same
+// ticks; their end states differ if the save left out anything the simulation depends on.
+static int RunSaveCheck(int rounds) {
+	const int roundTicks = 600;
+	World world(defaultMapWidth, defaultMapHeight), loaded(1, 1);
+	world.NewGame(1);
+	PlaceSyntheticBase(world);
+	std::vector<unsigned char> save;
+	int diverged = 0;
+	for (int round = 0; round < rounds; round++) {
+		world.Serialize(save);
+		if (!loaded.Deserialize(save)) {
+			fprintf(stderr, "round %d: save did not load\n", round);
+			return 1;
+		}
+		size_t shots = world.projectiles.Live();
+		for (int i = 0; i < roundTicks; i++) {
+			world.Tick(World::fixedStep);
+			loaded.Tick(World::fixedStep);
+		}
+		if (world.StateHash() == loaded.StateHash()) continue;
+		printf("round %d: diverged (%zu shots in flight at save)\n", round, shots);
+		diverged++;
+	}
+	printf("save/load check: %d of %d rounds diverged\n", diverged, rounds);
+	return diverged > 0 ? 2 : 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 2 && strcmp(argv[1], "--replay") == 0) return RunReplay(argv[2]);
+	if (argc > 1 && strcmp(argv[1], "--check-save") == 0) return RunSaveCheck(argc > 2 ? std::max(atoi(argv[2]), 1) : 60);
+	double seconds = argc > 1 ? atof(argv[1]) : 3600.0;
+	float speed = argc > 2 ? atof(argv[2]) : 1.0f;
+	if (!(speed > 0.0f && speed <= maxTimeSpeed)) {
+		fprintf(stderr, "time speed must be above 0 and at most %g\n", maxTimeSpeed);
+		return 1;
+	}
+	int width = argc > 3 ? atoi(argv[3]) : defaultMapWidth;
+	int height = argc > 4 ? atoi(argv[4]) : width;
+	World world(std::clamp(width, 1, maxMapSide), std::clamp(height, 1, maxMapSide));
+	world.NewGame();
+	PlaceSyntheticBase(world);
+	world.timeSpeed = speed;
+	long long steps = (long long)(seconds / speed / World::fixedStep);
+	auto start = std::chrono::steady_clock::now();
+	for (long long i = 0; i < steps; i++)
+		world.Step(World::fixedStep);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("buildings: %zu\n", world.Buildings().size());
+	printf("steps: %lld in %.3f s (%.0f steps/s)\n", steps, elapsed, elapsed > 0 ? steps / elapsed : 0.0);
+	printf("gold %d, tree %d, iron %d, ammoCore %d\n", world.gold, world.tree, world.iron, world.ammoCore);
+	printf("wave %d, enemies %zu, base health %d\n", world.wave, world.enemies.Count(), world.baseHealth);
+	return 0;
+}
@@ -0,0 +1,68 @@
+#include "logistics.h"
+#include <algorithm>
+#include <limits>
+
+void FlowGraph::Reset(int nodeCount) {
+	first.assign(nodeCount, -1);
+	head.clear();
+	next.clear();
+	capacity.clear();
+	limit.clear();
+}
+
+int FlowGraph::AddArc(int from, int to, int cap, int back) {
+	int arc = head.size();
+	head.push_back(to);
+	next.push_back(first[from]);
+	capacity.push_back(cap);
+	limit.push_back(cap);
+	first[from] = arc;
+	head.push_back(from);
+	next.push_back(first[to]);
+	capacity.push_back(back);
+	limit.push_back(back);
+	first[to] = arc + 1;
+	return arc;
+}
+
+long long FlowGraph::MaxFlow(int source, int sink) {
+	long long total = 0;
+	while (Levels(source, sink)) {
+		cursor = first;
+		while (int sent = Push(source, sink, std::numeric_limits<int>::max())) total += sent;
+	}
+	return total;
+}
+
+// Layers the nodes by BFS distance from the source over arcs that can still carry something.
+bool FlowGraph::Levels(int source, int sink) {
+	level.assign(first.size(), -1);
+	queue.assign(1, source);
+	level[source] = 0;
+	for (size_t i = 0; i < queue.size(); i++) {
+		int u = queue[i];
+		for (int arc = first[u]; arc >= 0; arc = next[arc])
+			if (capacity[arc] > 0 && level[head[arc]] < 0) {
+				level[head[arc]] = level[u] + 1;
+				queue.push_back(head[arc]);
+			}
+	}
+	return level[sink] >= 0;
+}
+
+// Sends up to `amount` from `node` to the sink along arcs that go one level deeper. Each node's cursor
+// skips arcs that are full or lead nowhere, so every arc is given up on at most once per phase.
+int FlowGraph::Push(int node, int sink, int amount) {
+	if (node == sink) return amount;
+	int sent = 0;
+	for (int &arc = cursor[node]; arc >= 0; arc = next[arc]) {
+		int to = head[arc];
+		if (capacity[arc] <= 0 || level[to] != level[node] + 1) continue;
+		int pushed = Push(to, sink, std::min(amount - sent, capacity[arc]));
+		capacity[arc] -= pushed;
+		capacity[arc ^ 1] += pushed;
+		sent += pushed;
+		if (sent == amount) break;
+	}
+	return sent;
+}
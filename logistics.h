@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+
+// Maximum flow by Dinic's algorithm, for routing goods over the transport network. The graph is rebuilt
+// from scratch whenever the network changes; its arrays keep their capacity across Reset(), so rebuilding
+// a graph of about the same size does not allocate.
+struct FlowGraph {
+	void Reset(int nodeCount);
+	// Adds an arc from `from` to `to` carrying up to `capacity`, paired with one back carrying up to `back`
+	// (0 for a one-way arc), and returns the id of the first.
+	int AddArc(int from, int to, int capacity, int back = 0);
+	// Sends as much as fits from source to sink and returns how much that was.
+	long long MaxFlow(int source, int sink);
+
+	int From(int arc) const { return head[arc ^ 1]; }
+	int To(int arc) const { return head[arc]; }
+	// Net amount sent along an arc by the last MaxFlow().
+	int Flow(int arc) const { return limit[arc] - capacity[arc]; }
+
+private:
+	// Per node: its first arc, BFS level and the next arc to try while pushing.
+	std::vector<int> first, level, cursor;
+	// Per arc: the node it points to, the next arc out of the same node, what it can still carry and its
+	// capacity. Arcs come in pairs, arc ^ 1 being the reverse of arc.
+	std::vector<int> head, next, capacity, limit;
+	std::vector<int> queue;
+
+	bool Levels(int source, int sink);
+	int Push(int node, int sink, int amount);
+};
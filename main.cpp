@@ -1,28 +1,62 @@
 #include "raylib.h"
 #include "raymath.h"
+#include "world.h"
+#include "save.h"
+#include "profiler.h"
+#include "replay.h"
+#include "simthread.h"
+#include "fontcache.h"
 #include <vector>
-#include <queue>
-#include <unordered_set>
-#include <unordered_map>
-#include <fstream>
+#include <string_view>
+#include <iterator>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 using namespace std;
 
-static float gameTime = 8.0f;
-static float timer = 0;
-static float timeSpeed = 1.0f;
-static float timeOfDay = 8.0f / 24.0f;
-static float resourceTimer = 0.0f;
 float scale = 1.0f;
 float playerSpeed = 100.0f;
 
 
-unordered_map<string, unordered_map<string, string>> translations;
-std::string currentLanguage = "en";
-std::string t(const std::string& key) {
-    return translations[currentLanguage][key];
-}
+// Every UI string, looked up by key in the table of the current language.
+enum TextKey {
+	TXT_PLAY, TXT_CONTINUE, TXT_SETTINGS, TXT_SETTING_TITLE, TXT_EXIT, TXT_BACK,
+	TXT_MUSIC_ON, TXT_MUSIC_OFF, TXT_SFX_ON, TXT_SFX_OFF, TXT_LANGUAGE, TXT_TITLE,
+	TXT_BASE, TXT_GOLD_MINE, TXT_IRON_MINE, TXT_CANNON, TXT_TRANSPORTER, TXT_SAWMILL, TXT_FACTORY, TXT_ARCHER,
+	TXT_MENU, TXT_DELETE_ON, TXT_DELETE_OFF, TXT_PAUSE,
+	TXT_GOLD, TXT_TREE, TXT_IRON, TXT_AMMO_CORE, TXT_WAVE,
+	TXT_TARGET_NEAREST, TXT_TARGET_LOWEST_HEALTH, TXT_TARGET_FIRST, TXT_CAUGHT_UP, TXT_BAD_SAVE,
+	TXT_COUNT
+};
+
+constexpr std::string_view english[] = {
+	"New game", "Continue", "Settings", "Setting", "Exit", "Back",
+	"Music: On", "Music: Off", "SFX: On", "SFX: Off", "Language: English", "Defense of the Base",
+	"Base", "Gold Mine", "Iron Mine", "Cannon", "Transporter", "Sawmill", "Factory", "Archer",
+	"Menu", "Delete: On", "Delete: Off", "Pause",
+	"Gold", "Tree", "Iron", "Ammocore", "Wave",
+	"Target: Nearest", "Target: Weakest", "Target: First", "While you were away: %.1f h",
+	"The save could not be loaded and was kept as %s",
+};
+
+constexpr std::string_view ukrainian[] = {
+	"Нова гра", "Продовжити", "Налаштування", "Налаштування", "Вихід", "Назад",
+	"Музика: Вкл.", "Музика: Викл.", "Звуки: Вкл.", "Звуки: Викл.", "Мова: Українська", "Захист Бази",
+	"База", "Золота Шахта", "Залізна Шахта", "Гармата", "Транспортер", "Лісопилка", "Фабрика", "Лучник",
+	"Меню", "Видалити: Вкл", "Видалити: Викл", "Пауза",
+	"Золото", "Дерево", "Залізо", "Ядро", "Хвиля",
+	"Ціль: Найближча", "Ціль: Найслабша", "Ціль: Перша", "Поки вас не було: %.1f год.",
+	"Збереження не вдалося завантажити, його збережено як %s",
+};
 
-const int tileSize = 64, mapWidth = 40, mapHeight = 40;
+static_assert(std::size(english) == TXT_COUNT && std::size(ukrainian) == TXT_COUNT, "translation table out of sync with TextKey");
+
+const std::string_view *language = english;
+// Table entries are string literals, so data() is null-terminated.
+const char *t(TextKey key) { return language[key].data(); }
+
+const int tileSize = 64;
+const float minZoom = 0.5f, maxZoom = 3.0f;
 Camera2D camera = {0};
 Vector2 dragStart = {0};
 bool dragging = false;
@@ -34,98 +68,9 @@ enum GameState {
 	STATE_GAME 
 };
 
-enum BuildingType { 
-	BUILD_NONE, 
-	BUILD_BASE, 
-	BUILD_GOLD_MINE, 
-	BUILD_TRANSPORTER, 
-	BUILD_SAWMILL, 
-	BUILD_ARCHER, 
-	BUILD_IRON_MINE,
-	BUILD_FACTORY,
-	BUILD_CANNON,
-};
-
-struct Building { BuildingType type; int x, y; };
 GameState currentState = STATE_MENU;
 int selectedBuild = BUILD_NONE;
-std::vector<Building> buildings;
-std::unordered_set<int> connected;
-std::unordered_map<int, int> cannonAmmo;
-int gold = 0;
-int tree = 0;
-int iron = 0;
-int ammoCore = 0;
-bool basePlaced = false;
-
-void InitTranslations() {
-	translations["en"] = {
-        {"play", "New game"},
-        {"continue", "Continue"},
-        {"settings", "Settings"},
-        {"Setting", "Setting"},
-        {"exit", "Exit"},
-        {"back", "Back"},
-        {"music_on", "Music: On"},
-        {"music_off", "Music: Off"},
-        {"sfx_on", "SFX: On"},
-        {"sfx_off", "SFX: Off"},
-        {"language_ua", "Language: Ukrainian"},
-        {"language_en", "Language: English"},
-        {"title", "Defense of the Base"},
-        {"base", "Base"},
-        {"gold_mine", "Gold Mine"},
-        {"iron_mine", "Iron Mine"},
-        {"cannon", "Cannon"},
-        {"transporter", "Transporter"},
-        {"sawmill", "Sawmill"},
-        {"factory", "Factory"},
-        {"archer", "Archer"},
-        {"menu", "Menu"},
-        {"delete_on", "Delete: On"},
-        {"delete_off", "Delete: Off"},
-        {"pause", "Pause"},
-        {"gold", "Gold"},
-        {"tree", "Tree"},
-        {"iron", "Iron"},
-        {"ammoCore", "Ammocore"}
-    };
-    translations["ua"] = {
-        {"play", "Нова гра"},
-        {"continue", "Продовжити"},
-        {"settings", "Налаштування"},
-        {"Setting", "Налаштування"},
-        {"exit", "Вихід"},
-        {"back", "Назад"},
-        {"music_on", "Музика: Вкл."},
-        {"music_off", "Музика: Викл."},
-        {"sfx_on", "Звуки: Вкл."},
-        {"sfx_off", "Звуки: Викл."},
-        {"language_ua", "Мова: Українська"},
-        {"language_en", "Мова: Англійська"},
-        {"title", "Захист Бази"},
-        {"base", "База"},
-        {"gold_mine", "Золота Шахта"},
-        {"iron_mine", "Залізна Шахта"},
-        {"cannon", "Гармата"},
-        {"transporter", "Транспортер"},
-        {"sawmill", "Лісопилка"},
-        {"factory", "Фабрика"},
-        {"archer", "Лучник"},
-        {"menu", "Меню"},
-        {"delete_on", "Видалити: Вкл"},
-        {"delete_off", "Видалити: Викл"},
-        {"pause", "Пауза"},
-        {"gold", "Золото"},
-        {"tree", "Дерево"},
-        {"iron", "Залізо"},
-        {"ammoCore", "Ядро"}
-    };
-}
-
-bool IsInsideMap(int x, int y) {
-    return x >= 0 && x < mapWidth && y >= 0 && y < mapHeight;
-}
+World world;
 
 const char *chars =
     "АБВГҐДЕЄЖЗИІЇЙКЛМНОПРСТУФХЦЧШЩЬЮЯ"
@@ -134,44 +79,531 @@ const char *chars =
     "abcdefghijklmnopqrstuvwxyz"
     "0123456789 .,!?:;-_()[]{}|←✓";
     
-int PosToIndex(int x, int y) { return y * mapWidth + x; }
-
-void UpdateConnections() {
-    connected.clear();
-    std::queue<std::pair<Building*, int>> q;
-    for (auto &b : buildings)
-        if (b.type == BUILD_BASE) {
-            connected.insert(PosToIndex(b.x, b.y));
-            q.push({&b, 0});
-        }
-    while (!q.empty()) {
-        auto [u, depth] = q.front(); q.pop();
-        if (depth >= 5) continue;
-        for (auto &t : buildings) {
-            if (t.type != BUILD_TRANSPORTER) continue;
-            int idx = PosToIndex(t.x, t.y);
-            if (connected.count(idx)) continue;
-            int d = abs(u->x - t.x) + abs(u->y - t.y);
-            if (d <= 5) {connected.insert(idx);
-                q.push({&t, depth + 1});
-            }
-        }
-    }
-    for (auto &b : buildings) {
-        if (b.type == BUILD_GOLD_MINE || b.type == BUILD_SAWMILL || b.type == BUILD_ARCHER || b.type == BUILD_IRON_MINE || b.type == BUILD_FACTORY || b.type == BUILD_CANNON) {
-            for (auto &t : buildings) {
-                int d = abs(b.x - t.x) + abs(b.y - t.y);
-                if (t.type == BUILD_TRANSPORTER && d <= 5 &&
-                    connected.count(PosToIndex(t.x, t.y))) {
-                    connected.insert(PosToIndex(b.x, b.y));
-                    break;
-                }
-            }
-        }
-    }
+// Terrain is baked into render textures of chunkTiles x chunkTiles tiles. Only chunks inside the camera
+// view are baked and drawn; textures come from a fixed pool and are handed to other chunks once out of view.
+const int chunkTiles = 16;
+const int chunkPixels = chunkTiles * tileSize;
+
+struct TerrainSlot {
+	RenderTexture2D target;
+	int chunk;
+	bool dirty;
+	unsigned lastUsed;
+};
+
+struct TerrainCache {
+	std::vector<TerrainSlot> slots;
+	std::vector<int> slotOf;
+	int chunkCols = 0, chunkRows = 0;
+	int capacity = 0;
+	unsigned frame = 0;
+
+	// The pool holds enough chunks to cover the screen at the lowest zoom level.
+	void Init(int screenWidth, int screenHeight) {
+		int cols = screenWidth / (chunkPixels * minZoom) + 2;
+		int rows = screenHeight / (chunkPixels * minZoom) + 2;
+		capacity = cols * rows;
+	}
+
+	// Drops all chunk assignments, e.g. after a new game or load that may have changed the map size.
+	void Reset(int mapWidth, int mapHeight) {
+		chunkCols = (mapWidth + chunkTiles - 1) / chunkTiles;
+		chunkRows = (mapHeight + chunkTiles - 1) / chunkTiles;
+		slotOf.assign(chunkCols * chunkRows, -1);
+		for (auto &s : slots) {
+			s.chunk = -1;
+			s.dirty = true;
+			s.lastUsed = 0;
+		}
+	}
+
+	// Assigns and bakes textures for the visible chunks. Must run outside BeginMode2D.
+	void Prepare(const WorldSnapshot &world, Rectangle view) {
+		PROFILE_SCOPE("terrain bake");
+		frame++;
+		int cx0, cy0, cx1, cy1;
+		VisibleChunks(view, cx0, cy0, cx1, cy1);
+		for (int cy = cy0; cy <= cy1; cy++)
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int chunk = cy * chunkCols + cx;
+				int s = slotOf[chunk];
+				if (s < 0 && (s = Acquire(chunk)) < 0) continue;
+				slots[s].lastUsed = frame;
+				if (slots[s].dirty) Bake(world, slots[s]);
+			}
+	}
+
+	void Draw(Rectangle view) const {
+		PROFILE_SCOPE("terrain draw");
+		int cx0, cy0, cx1, cy1;
+		VisibleChunks(view, cx0, cy0, cx1, cy1);
+		for (int cy = cy0; cy <= cy1; cy++)
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int s = slotOf[cy * chunkCols + cx];
+				if (s < 0 || slots[s].lastUsed != frame) continue;
+				Rectangle src = {0, 0, (float)chunkPixels, -(float)chunkPixels};
+				DrawTextureRec(slots[s].target.texture, src, {(float)cx * chunkPixels, (float)cy * chunkPixels}, WHITE);
+			}
+	}
+
+	void Unload() {
+		for (auto &s : slots) UnloadRenderTexture(s.target);
+		slots.clear();
+	}
+
+private:
+	void VisibleChunks(Rectangle view, int &cx0, int &cy0, int &cx1, int &cy1) const {
+		cx0 = std::max(0, (int)floorf(view.x / chunkPixels));
+		cy0 = std::max(0, (int)floorf(view.y / chunkPixels));
+		cx1 = std::min(chunkCols - 1, (int)floorf((view.x + view.width) / chunkPixels));
+		cy1 = std::min(chunkRows - 1, (int)floorf((view.y + view.height) / chunkPixels));
+	}
+
+	int Acquire(int chunk) {
+		int s = -1;
+		if ((int)slots.size() < capacity) {
+			s = slots.size();
+			slots.push_back({LoadRenderTexture(chunkPixels, chunkPixels), -1, true, 0});
+		} else {
+			for (int i = 0; i < (int)slots.size(); i++)
+				if (slots[i].lastUsed != frame && (s < 0 || slots[i].lastUsed < slots[s].lastUsed))
+					s = i;
+			if (s < 0) return -1;
+			if (slots[s].chunk >= 0) slotOf[slots[s].chunk] = -1;
+		}
+		slots[s].chunk = chunk;
+		slots[s].dirty = true;
+		slotOf[chunk] = s;
+		return s;
+	}
+
+	void Bake(const WorldSnapshot &world, TerrainSlot &slot) {
+		int x0 = (slot.chunk % chunkCols) * chunkTiles, y0 = (slot.chunk / chunkCols) * chunkTiles;
+		BeginTextureMode(slot.target);
+		ClearBackground(BLANK);
+		for (int y = y0; y < std::min(y0 + chunkTiles, world.height); y++)
+			for (int x = x0; x < std::min(x0 + chunkTiles, world.width); x++) {
+				Vector2 pos = {(float)(x - x0) * tileSize, (float)(y - y0) * tileSize};
+				int resource = world.ResourceAt(x, y);
+				DrawRectangleV(pos, {tileSize - 2, tileSize - 2}, LIGHTGRAY);
+				if (resource == 1) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, GREEN);
+				if (resource == 2) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, GOLD);
+				if (resource == 3) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, DARKGRAY);
+			}
+		EndTextureMode();
+		slot.dirty = false;
+	}
+};
+
+TerrainCache terrain;
+
+// Below this zoom buildings are drawn as one impostor per terrain chunk: a texture with a pixel per tile.
+const float buildingLodZoom = 0.7f;
+const int digitWidth = 12, digitHeight = 20;
+
+const Color buildingColors[] = {BLANK, YELLOW, GOLD, SKYBLUE, BROWN, PURPLE, GRAY, GREEN, RED};
+const int buildingTypes = sizeof(buildingColors) / sizeof(buildingColors[0]);
+
+// Draws every building from one atlas texture, so a frame of buildings batches into a handful of draw calls
+// however many there are. The atlas holds one tile-sized sprite per type, outline included, and the digits
+// for the cannon ammo labels. Building indices are sorted by terrain chunk and, within a chunk, by type
+// whenever the buildings change, which keeps culling to the chunks in view.
+struct BuildingRenderer {
+	Texture2D atlas = {0};
+	Texture2D impostors = {0};
+	int impostorCols = 0;
+	std::vector<int> byType, order;
+	std::vector<int> chunkStart;
+	std::vector<int> typeStart;
+	int chunkCols = 0, chunkRows = 0;
+	uint64_t revision = 0;
+	bool sorted = false;
+	// Impostor cells are handed out to chunks in view, like terrain textures.
+	std::vector<int> cellOf;
+	std::vector<int> cellChunk;
+	std::vector<unsigned> cellUsed;
+	std::vector<uint64_t> cellRevision;
+	std::vector<Color> pixels;
+	unsigned frame = 0;
+
+	void Init(int capacity) {
+		Image image = GenImageColor(tileSize * buildingTypes, tileSize + digitHeight, BLANK);
+		for (int type = BUILD_BASE; type < buildingTypes; type++) {
+			int size = type == BUILD_TRANSPORTER ? (tileSize - 16) / 3 : tileSize - 16;
+			int x = type * tileSize + (tileSize - size) / 2, y = (tileSize - size) / 2;
+			ImageDrawRectangle(&image, x, y, size, size, buildingColors[type]);
+			ImageDrawRectangleLines(&image, {(float)x, (float)y, (float)size, (float)size}, 4, BLACK);
+		}
+		for (int d = 0; d < 10; d++) ImageDrawText(&image, TextFormat("%d", d), d * digitWidth, tileSize, digitHeight, WHITE);
+		atlas = LoadTextureFromImage(image);
+		UnloadImage(image);
+		impostorCols = (int)ceilf(sqrtf((float)capacity));
+		image = GenImageColor(impostorCols * chunkTiles, impostorCols * chunkTiles, BLANK);
+		impostors = LoadTextureFromImage(image);
+		UnloadImage(image);
+		cellChunk.assign(impostorCols * impostorCols, -1);
+		cellUsed.assign(cellChunk.size(), 0);
+		cellRevision.assign(cellChunk.size(), 0);
+		pixels.resize(chunkTiles * chunkTiles);
+	}
+
+	void Reset(int mapWidth, int mapHeight) {
+		chunkCols = (mapWidth + chunkTiles - 1) / chunkTiles;
+		chunkRows = (mapHeight + chunkTiles - 1) / chunkTiles;
+		cellOf.assign(chunkCols * chunkRows, -1);
+		std::fill(cellChunk.begin(), cellChunk.end(), -1);
+		sorted = false;
+	}
+
+	void Draw(const WorldSnapshot &world, Rectangle view, float zoom) {
+		PROFILE_SCOPE("buildings");
+		frame++;
+		if (!sorted || revision != world.revision) Sort(world);
+		int cx0 = std::max(0, (int)floorf(view.x / chunkPixels)), cy0 = std::max(0, (int)floorf(view.y / chunkPixels));
+		int cx1 = std::min(chunkCols - 1, (int)floorf((view.x + view.width) / chunkPixels));
+		int cy1 = std::min(chunkRows - 1, (int)floorf((view.y + view.height) / chunkPixels));
+		for (int cy = cy0; cy <= cy1; cy++)
+			for (int cx = cx0; cx <= cx1; cx++) {
+				int chunk = cy * chunkCols + cx;
+				if (chunkStart[chunk] == chunkStart[chunk + 1]) continue;
+				if (zoom < buildingLodZoom) DrawImpostor(world, chunk);
+				else DrawChunk(world, chunk);
+			}
+	}
+
+	void Unload() {
+		UnloadTexture(atlas);
+		UnloadTexture(impostors);
+	}
+
+private:
+	// Two counting sorts, by type and then stably by chunk.
+	void Sort(const WorldSnapshot &world) {
+		size_t n = world.buildings.size();
+		typeStart.assign(buildingTypes + 1, 0);
+		for (const Building &b : world.buildings) typeStart[b.type + 1]++;
+		for (int t = 0; t < buildingTypes; t++) typeStart[t + 1] += typeStart[t];
+		byType.resize(n);
+		for (size_t i = 0; i < n; i++) byType[typeStart[world.buildings[i].type]++] = i;
+		chunkStart.assign(chunkCols * chunkRows + 1, 0);
+		for (const Building &b : world.buildings) chunkStart[ChunkOf(b) + 1]++;
+		for (int c = 0; c < chunkCols * chunkRows; c++) chunkStart[c + 1] += chunkStart[c];
+		order.resize(n);
+		for (int i : byType) order[chunkStart[ChunkOf(world.buildings[i])]++] = i;
+		for (int c = chunkCols * chunkRows; c > 0; c--) chunkStart[c] = chunkStart[c - 1];
+		chunkStart[0] = 0;
+		revision = world.revision;
+		sorted = true;
+	}
+
+	int ChunkOf(const Building &b) const { return (b.y / chunkTiles) * chunkCols + b.x / chunkTiles; }
+
+	void DrawChunk(const WorldSnapshot &world, int chunk) {
+		for (int k = chunkStart[chunk]; k < chunkStart[chunk + 1]; k++) {
+			int i = order[k];
+			const Building &b = world.buildings[i];
+			Rectangle src = {(float)b.type * tileSize, 0, tileSize, tileSize};
+			DrawTextureRec(atlas, src, {(float)b.x * tileSize, (float)b.y * tileSize}, WHITE);
+			if (!world.powered[i]) continue;
+			Vector2 label = {(float)b.x * tileSize + 10, (float)b.y * tileSize + 10};
+			if (b.type == BUILD_ARCHER) DrawNumber(0, label);
+			if (b.type == BUILD_CANNON) DrawNumber(world.ammo[i], label);
+		}
+	}
+
+	void DrawNumber(int value, Vector2 pos) {
+		char digits[12];
+		int len = snprintf(digits, sizeof(digits), "%d", value);
+		for (int d = 0; d < len; d++) {
+			Rectangle src = {(float)(digits[d] - '0') * digitWidth, tileSize, digitWidth, digitHeight};
+			DrawTextureRec(atlas, src, {pos.x + d * digitWidth, pos.y}, WHITE);
+		}
+	}
+
+	void DrawImpostor(const WorldSnapshot &world, int chunk) {
+		int cell = cellOf[chunk];
+		if (cell < 0 && (cell = AcquireCell(chunk)) < 0) return;
+		cellUsed[cell] = frame;
+		Rectangle dst = {(float)(cell % impostorCols) * chunkTiles, (float)(cell / impostorCols) * chunkTiles, chunkTiles, chunkTiles};
+		if (cellRevision[cell] != world.revision) {
+			std::fill(pixels.begin(), pixels.end(), BLANK);
+			int x0 = (chunk % chunkCols) * chunkTiles, y0 = (chunk / chunkCols) * chunkTiles;
+			for (int k = chunkStart[chunk]; k < chunkStart[chunk + 1]; k++) {
+				const Building &b = world.buildings[order[k]];
+				pixels[(b.y - y0) * chunkTiles + (b.x - x0)] = buildingColors[b.type];
+			}
+			UpdateTextureRec(impostors, dst, pixels.data());
+			cellRevision[cell] = world.revision;
+		}
+		Rectangle target = {(float)(chunk % chunkCols) * chunkPixels, (float)(chunk / chunkCols) * chunkPixels, chunkPixels, chunkPixels};
+		DrawTexturePro(impostors, dst, target, {0, 0}, 0.0f, WHITE);
+	}
+
+	int AcquireCell(int chunk) {
+		int cell = -1;
+		for (int i = 0; i < (int)cellChunk.size(); i++)
+			if (cellUsed[i] != frame && (cell < 0 || cellUsed[i] < cellUsed[cell])) cell = i;
+		if (cell < 0) return -1;
+		if (cellChunk[cell] >= 0) cellOf[cellChunk[cell]] = -1;
+		cellChunk[cell] = chunk;
+		cellOf[chunk] = cell;
+		cellRevision[cell] = 0;
+		return cell;
+	}
+};
+
+BuildingRenderer buildingRenderer;
+
+// Minimap sides are capped at this many pixels; larger maps get one pixel per square block of tiles.
+const int maxMinimapSide = 1024;
+// Enemies are counted per cell of densityCell x densityCell pixels, and the texture is uploaded in bands of
+// minimapBand rows, each covering only the columns that changed in it.
+const int densityCell = 4;
+const int minimapBand = 32;
+const int maxDensityLevel = 4;
+
+// Minimap with a CPU copy of its pixels. Only pixels whose colour changes are rewritten and uploaded:
+// those under tiles the snapshot's mark changes list (buildings placed, removed or switching power), and
+// those of density cells whose enemy count level changed since the last frame.
+struct Minimap {
+	Texture2D texture = {0};
+	int cols = 0, rows = 0;
+	int tilesPerPixel = 1;
+	int cellCols = 0;
+	bool visible = true;
+	// Per pixel: terrain colour, strongest mark of its tiles and the colour last uploaded, and how many of its
+	// tiles carry each mark but MARK_NONE. Per density cell: enemy count this frame and the level shown.
+	std::vector<Color> terrain, pixels;
+	std::vector<uint8_t> state;
+	std::vector<uint16_t> markCounts;
+	std::vector<int> counts;
+	std::vector<uint8_t> density;
+	// Cells holding enemies, as of the last and the current update.
+	std::vector<int> touched, previousTouched;
+	std::vector<int> bandMin, bandMax;
+	std::vector<Color> upload;
+	// Mark changes followed so far; only meaningful once counted.
+	uint64_t marksSeen = 0;
+	bool baked = false, counted = false;
+
+	void Reset(int mapWidth, int mapHeight) {
+		tilesPerPixel = (std::max(mapWidth, mapHeight) + maxMinimapSide - 1) / maxMinimapSide;
+		int newCols = (mapWidth + tilesPerPixel - 1) / tilesPerPixel, newRows = (mapHeight + tilesPerPixel - 1) / tilesPerPixel;
+		if (texture.id == 0 || newCols != cols || newRows != rows) {
+			if (texture.id != 0) UnloadTexture(texture);
+			Image image = GenImageColor(newCols, newRows, BLANK);
+			texture = LoadTextureFromImage(image);
+			UnloadImage(image);
+		}
+		cols = newCols;
+		rows = newRows;
+		cellCols = (cols + densityCell - 1) / densityCell;
+		state.assign(cols * rows, 0);
+		markCounts.assign(cols * rows * (MARK_KINDS - 1), 0);
+		counts.assign(cellCols * ((rows + densityCell - 1) / densityCell), 0);
+		density.assign(counts.size(), 0);
+		touched.clear();
+		bandMin.assign((rows + minimapBand - 1) / minimapBand, cols);
+		bandMax.assign(bandMin.size(), -1);
+		baked = false;
+		counted = false;
+	}
+
+	void Update(const WorldSnapshot &world) {
+		PROFILE_SCOPE("minimap");
+		if (!baked) Bake(world);
+		UpdateBuildings(world);
+		UpdateDensity(world);
+		Upload();
+	}
+
+	// Square area of `side` pixels in the top right corner, less along the map's shorter side.
+	Rectangle Bounds(int screenWidth, float side) const {
+		float pixel = side / std::max(cols, rows);
+		return {screenWidth - cols * pixel - 10, 115, cols * pixel, rows * pixel};
+	}
+
+	// The map position under a screen point inside Bounds().
+	Vector2 WorldAt(Rectangle bounds, Vector2 point) const {
+		float tiles = (float)cols * tilesPerPixel / bounds.width;
+		return {(point.x - bounds.x) * tiles * tileSize, (point.y - bounds.y) * tiles * tileSize};
+	}
+
+	void Draw(Rectangle bounds, Rectangle view) const {
+		DrawTexturePro(texture, {0, 0, (float)cols, (float)rows}, bounds, {0, 0}, 0.0f, WHITE);
+		float pixel = bounds.width / ((float)cols * tilesPerPixel * tileSize);
+		Rectangle frame = {bounds.x + view.x * pixel, bounds.y + view.y * pixel, view.width * pixel, view.height * pixel};
+		DrawRectangleLinesEx(frame, 1.0f, WHITE);
+		DrawRectangleLinesEx(bounds, 2.0f, BLACK);
+	}
+
+	void Unload() {
+		if (texture.id != 0) UnloadTexture(texture);
+		texture = {0};
+	}
+
+private:
+	int PixelOf(int x, int y) const { return (y / tilesPerPixel) * cols + x / tilesPerPixel; }
+	int CellOf(int pixel) const { return (pixel / cols / densityCell) * cellCols + pixel % cols / densityCell; }
+
+	// Terrain shows each block's most common resource, fading into grass by how much of the block it covers.
+	void Bake(const WorldSnapshot &world) {
+		static const Color resourceColors[4] = {LIGHTGRAY, GREEN, GOLD, DARKGRAY};
+		terrain.assign(cols * rows, LIGHTGRAY);
+		for (int py = 0; py < rows; py++)
+			for (int px = 0; px < cols; px++) {
+				int found[4] = {0, 0, 0, 0}, area = 0;
+				for (int y = py * tilesPerPixel; y < std::min((py + 1) * tilesPerPixel, world.height); y++)
+					for (int x = px * tilesPerPixel; x < std::min((px + 1) * tilesPerPixel, world.width); x++, area++)
+						found[world.ResourceAt(x, y)]++;
+				int best = 1;
+				for (int r = 2; r < 4; r++)
+					if (found[r] > found[best]) best = r;
+				if (found[best] == 0) continue;
+				float share = tilesPerPixel == 1 ? 1.0f : std::min(1.0f, 4.0f * found[best] / area);
+				terrain[py * cols + px] = Mix(LIGHTGRAY, resourceColors[best], share);
+			}
+		pixels.resize(cols * rows);
+		for (int p = 0; p < cols * rows; p++) pixels[p] = Compose(p);
+		UpdateTexture(texture, pixels.data());
+		baked = true;
+	}
+
+	// Follows the mark changes since the last update, touching only their pixels. Having missed some, it
+	// counts every building again instead.
+	void UpdateBuildings(const WorldSnapshot &world) {
+		if (!counted || marksSeen < world.markFirst) {
+			std::fill(markCounts.begin(), markCounts.end(), 0);
+			for (size_t i = 0; i < world.buildings.size(); i++) {
+				const Building &b = world.buildings[i];
+				TileMark mark = b.type == BUILD_BASE ? MARK_BASE : world.powered[i] ? MARK_POWERED : MARK_UNPOWERED;
+				markCounts[PixelOf(b.x, b.y) * (MARK_KINDS - 1) + mark - 1]++;
+			}
+			for (int p = 0; p < cols * rows; p++) Restate(p);
+			counted = true;
+		} else {
+			for (size_t i = marksSeen - world.markFirst; i < world.markChanges.size(); i++) {
+				const MarkChange &change = world.markChanges[i];
+				int p = PixelOf(change.tile % world.width, change.tile / world.width);
+				if (change.from != MARK_NONE) markCounts[p * (MARK_KINDS - 1) + change.from - 1]--;
+				if (change.to != MARK_NONE) markCounts[p * (MARK_KINDS - 1) + change.to - 1]++;
+				Restate(p);
+			}
+		}
+		marksSeen = world.markFirst + world.markChanges.size();
+	}
+
+	void Restate(int p) {
+		uint8_t strongest = MARK_NONE;
+		for (int mark = MARK_BASE; mark > MARK_NONE && strongest == MARK_NONE; mark--)
+			if (markCounts[p * (MARK_KINDS - 1) + mark - 1] > 0) strongest = mark;
+		if (strongest == state[p]) return;
+		state[p] = strongest;
+		Recompose(p);
+	}
+
+	void UpdateDensity(const WorldSnapshot &world) {
+		for (int cell : touched) counts[cell] = 0;
+		touched.swap(previousTouched);
+		touched.clear();
+		for (size_t i = 0; i < world.enemyX.size(); i++) {
+			int x = std::clamp((int)world.enemyX[i], 0, world.width - 1), y = std::clamp((int)world.enemyY[i], 0, world.height - 1);
+			int cell = CellOf(PixelOf(x, y));
+			if (counts[cell]++ == 0) touched.push_back(cell);
+		}
+		for (int cell : previousTouched) Refresh(cell);
+		for (int cell : touched) Refresh(cell);
+	}
+
+	void Refresh(int cell) {
+		uint8_t level = std::min(counts[cell], maxDensityLevel);
+		if (level == density[cell]) return;
+		density[cell] = level;
+		int x0 = cell % cellCols * densityCell, y0 = cell / cellCols * densityCell;
+		for (int y = y0; y < std::min(y0 + densityCell, rows); y++)
+			for (int x = x0; x < std::min(x0 + densityCell, cols); x++) Recompose(y * cols + x);
+	}
+
+	Color Compose(int p) const {
+		static const Color stateColors[4] = {BLANK, ORANGE, BLUE, WHITE};
+		Color c = state[p] ? stateColors[state[p]] : terrain[p];
+		int level = density[CellOf(p)];
+		return level ? Mix(c, RED, 0.2f + 0.15f * level) : c;
+	}
+
+	static Color Mix(Color a, Color b, float t) {
+		return {(unsigned char)(a.r + (b.r - a.r) * t), (unsigned char)(a.g + (b.g - a.g) * t), (unsigned char)(a.b + (b.b - a.b) * t), 255};
+	}
+
+	void Recompose(int p) {
+		Color c = Compose(p);
+		if (c.r == pixels[p].r && c.g == pixels[p].g && c.b == pixels[p].b) return;
+		pixels[p] = c;
+		int band = p / cols / minimapBand, x = p % cols;
+		bandMin[band] = std::min(bandMin[band], x);
+		bandMax[band] = std::max(bandMax[band], x);
+	}
+
+	void Upload() {
+		for (int band = 0; band < (int)bandMin.size(); band++) {
+			if (bandMax[band] < bandMin[band]) continue;
+			int y0 = band * minimapBand, y1 = std::min(y0 + minimapBand, rows);
+			int x0 = bandMin[band], w = bandMax[band] - x0 + 1;
+			upload.resize(w * (y1 - y0));
+			for (int y = y0; y < y1; y++) std::copy_n(&pixels[y * cols + x0], w, &upload[(y - y0) * w]);
+			UpdateTextureRec(texture, {(float)x0, (float)y0, (float)w, (float)(y1 - y0)}, upload.data());
+			bandMin[band] = cols;
+			bandMax[band] = -1;
+		}
+	}
+};
+
+Minimap minimap;
+
+// The UI font baked at a few sizes instead of one oversized atlas. Text is drawn from the smallest atlas at
+// least as large as it (the largest for anything bigger), and each size is loaded the first time it is drawn.
+const int fontSizes[] = {32, 64, 128};
+const int fontSizeCount = sizeof(fontSizes) / sizeof(fontSizes[0]);
+
+struct FontSet {
+	const char *path = nullptr;
+	int *codepoints = nullptr;
+	int codepointCount = 0;
+	Font fonts[fontSizeCount] = {};
+	bool loaded[fontSizeCount] = {};
+
+	void Init(const char *fontPath, const char *text) {
+		path = fontPath;
+		codepoints = LoadCodepoints(text, &codepointCount);
+	}
+
+	const Font &For(float size) {
+		int i = 0;
+		while (i + 1 < fontSizeCount && fontSizes[i] < size) i++;
+		if (!loaded[i]) {
+			fonts[i] = LoadFontCached(path, fontSizes[i], codepoints, codepointCount);
+			SetTextureFilter(fonts[i].texture, TEXTURE_FILTER_BILINEAR);
+			loaded[i] = true;
+		}
+		return fonts[i];
+	}
+
+	void Unload() {
+		for (int i = 0; i < fontSizeCount; i++)
+			if (loaded[i]) UnloadFont(fonts[i]);
+		UnloadCodepoints(codepoints);
+	}
+};
+
+void DrawTextEx(FontSet &font, const char *text, Vector2 position, float fontSize, float spacing, Color tint) {
+	DrawTextEx(font.For(fontSize), text, position, fontSize, spacing, tint);
 }
 
-bool CheckButton(Rectangle btn, const char *text, Font font, float scale) {
+Vector2 MeasureTextEx(FontSet &font, const char *text, float fontSize, float spacing) {
+	return MeasureTextEx(font.For(fontSize), text, fontSize, spacing);
+}
+
+bool CheckButton(Rectangle btn, const char *text, FontSet &font, float scale) {
     bool hov = CheckCollisionPointRec(GetMousePosition(), btn);
     DrawRectangleRec(btn, hov ? DARKGREEN : GRAY);
     DrawRectangleLinesEx(btn, 2, WHITE);
@@ -181,110 +613,138 @@ bool CheckButton(Rectangle btn, const char *text, Font font, float scale) {
     return hov && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
 }
 
-bool IsFreeAround(const std::vector<std::vector<int>> &map, int x, int y);
-void GenerateClusters(std::vector<std::vector<int>> &map, int resourceId, int clusters, int size, int radius);
+SaveWriter saveWriter;
+std::vector<unsigned char> saveBuffer;
+SimThread sim;
 
-bool IsFreeAround(const std::vector<std::vector<int>> &map, int x, int y) {
-	for (int dy = -1; dy <= 1; dy++) {
-		for (int dx = -1; dx <= 1; dx++) {
-			int nx = x + dx;
-			int ny = y + dy;
-			if (nx >= 0 && nx < map[0].size() && ny >= 0 && ny < map.size()) {
-				if (map[ny][nx] != 0) return false;
-			}
-		}
+void SaveGame() {
+	PROFILE_SCOPE("save serialize");
+	world.Serialize(saveBuffer);
+	saveWriter.Submit(saveBuffer);
+	world.saveDirty = false;
+}
+
+// Game hours run on load for the time away, and how much longer to show that.
+float caughtUpHours = 0.0f;
+float caughtUpNotice = 0.0f;
+// A save that does not load is moved aside before the new game's autosave can replace it, and the player
+// told where it went.
+float badSaveNotice = 0.0f;
+
+bool LoadGame() {
+	std::vector<unsigned char> in;
+	if (!ReadSave(in)) return false;
+	if (!world.Deserialize(in)) {
+		if (SetAsideSave()) badSaveNotice = 8.0f;
+		else TraceLog(LOG_WARNING, "Could not move aside unreadable save %s", savePath);
+		return false;
 	}
+	caughtUpHours = world.CatchUp(SaveAgeSeconds());
+	caughtUpNotice = caughtUpHours > 0.0f ? 5.0f : 0.0f;
 	return true;
 }
 
-void GenerateIsolatedResources(std::vector<std::vector<int>> &map, int resourceId, int count) {
-	int width = map[0].size();
-	int height = map.size();
-	int placed = 0;
-	int attempts = 0;
-	while (placed < count && attempts < count * 50) {
-		int x = GetRandomValue(0, width - 1);
-		int y = GetRandomValue(0, height - 1);
-		if (map[y][x] == 0 && IsFreeAround(map, x, y)) {
-			map[y][x] = resourceId;
-			placed++;
-		}
-		attempts++;
+#ifdef ENABLE_PROFILER
+// F3 toggles the phase overlay, F4 starts a capture and, pressed again, writes profile.json and profile.csv.
+void DrawProfiler(FontSet &font) {
+	static bool visible = false;
+	if (IsKeyPressed(KEY_F3)) visible = !visible;
+	if (IsKeyPressed(KEY_F4)) {
+		if (!ProfilerCapturing()) ProfilerStartCapture();
+		else if (!ProfilerStopCapture("profile")) TraceLog(LOG_WARNING, "Could not write profile capture");
+	}
+	if (!visible) return;
+	PhaseStats stats[maxProfilePhases];
+	int count = ProfilerStats(stats, maxProfilePhases);
+	CounterValue counters[maxProfileCounters];
+	int counterCount = ProfilerCounters(counters, maxProfileCounters);
+	Rectangle panel = {GetScreenWidth() - 420.0f, 80, 410, 40.0f + 22 * (count + counterCount)};
+	DrawRectangleRec(panel, Fade(BLACK, 0.75f));
+	const char *header = ProfilerCapturing() ? "phase   min / avg / p99 ms   [REC]" : "phase   min / avg / p99 ms";
+	DrawTextEx(font, header, {panel.x + 10, panel.y + 8}, 20, 1, ProfilerCapturing() ? RED : WHITE);
+	for (int i = 0; i < count; i++) {
+		const char *line = TextFormat("%-16s %6.2f %6.2f %6.2f", stats[i].name, stats[i].minMs, stats[i].avgMs, stats[i].p99Ms);
+		DrawTextEx(font, line, {panel.x + 10, panel.y + 32 + 22 * i}, 20, 1, WHITE);
+	}
+	for (int i = 0; i < counterCount; i++) {
+		const char *line = TextFormat("%-16s %lld", counters[i].name, counters[i].value);
+		DrawTextEx(font, line, {panel.x + 10, panel.y + 32 + 22 * (count + i)}, 20, 1, SKYBLUE);
 	}
 }
+#endif
 
-void SaveGame(const std::vector<std::vector<int>>& map) {
-	std::ofstream save("save.dat");
-	for (const auto& row : map) {
-		for (int tile : row) {
-			save << tile << " ";
-		}
-		save << "\n";
-	}
-	save.close();
+int newMapWidth = defaultMapWidth, newMapHeight = defaultMapHeight;
+bool fixedSeed = false;
+uint32_t newGameSeed = 0;
+
+// With --record, every session from New game or Continue until the menu is written to recordPath.
+const char *recordPath = nullptr;
+Replay recording;
+
+void Issue(const Command &command) {
+	sim.Push(command);
 }
 
-void LoadGame(std::vector<std::vector<int>>& map) {
-	std::ifstream save("save.dat");
-	if (!save.is_open()) return;
-	for (int y = 0; y < map.size(); y++) {
-		for (int x = 0; x < map[y].size(); x++) {
-			save >> map[y][x];
-		}
-	}
-	save.close();
+// A session runs the world on the simulation thread; in between, the world belongs to the main thread.
+void BeginSession() {
+	if (recordPath) recording.Begin(world);
+	sim.Start(world, saveWriter, recordPath ? &recording : nullptr);
 }
 
-void NewGame(std::vector<std::vector<int>> &map) {
-	for (auto &row : map)
-		std::fill(row.begin(), row.end(), 0);
-	gameTime = 8.0f;
-	timeOfDay = 8.0f / 24.0f;
-	timer = 0.0f;
-	resourceTimer = 0.0f;
-	timeSpeed = 1.0f;
-	timer += GetFrameTime() * timeSpeed;
-	float adjustedDelta = GetFrameTime() * timeSpeed;
-	gameTime += adjustedDelta;
-	int hour = (int)(gameTime);
-	int minutes = (int)((gameTime - hour) * 60.0f);
+void EndSession() {
+	sim.Stop();
+	if (world.saveDirty) SaveGame();
+	if (!recordPath) return;
+	recording.Finish(world);
+	if (!WriteReplay(recordPath, recording)) TraceLog(LOG_WARNING, "Could not write replay %s", recordPath);
+}
+
+// Textures only the game view needs are created when the first session starts, so the menu comes up
+// without waiting on them.
+bool gameAssetsLoaded = false;
+
+void LoadGameAssets(int screenWidth, int screenHeight) {
+	if (gameAssetsLoaded) return;
+	terrain.Init(screenWidth, screenHeight);
+	buildingRenderer.Init(terrain.capacity);
+	gameAssetsLoaded = true;
+}
+
+void NewGame() {
+	if (world.width != newMapWidth || world.height != newMapHeight)
+		world.Resize(newMapWidth, newMapHeight);
+	if (fixedSeed) world.NewGame(newGameSeed);
+	else world.NewGame();
 	Vector2 playerPos = {100.0f, 100.0f};
 	camera.target = playerPos;
-	GenerateIsolatedResources(map, 1, 50);
-	GenerateIsolatedResources(map, 2, 20);
-	GenerateIsolatedResources(map, 3, 20);
-	buildings.clear();
-	connected.clear();
-	cannonAmmo.clear();
-	gold = 0;
-	iron = 0;
-	tree = 0;
-	ammoCore = 0;
-	basePlaced = false;
 }
 
-int main() {
-	InitTranslations();
+// Usage: defence [--map WIDTHxHEIGHT]
+int main(int argc, char **argv) {
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--map") == 0 && sscanf(argv[i + 1], "%dx%d", &newMapWidth, &newMapHeight) == 2) {
+			newMapWidth = std::clamp(newMapWidth, 1, maxMapSide);
+			newMapHeight = std::clamp(newMapHeight, 1, maxMapSide);
+		}
+		if (strcmp(argv[i], "--seed") == 0 && sscanf(argv[i + 1], "%u", &newGameSeed) == 1) fixedSeed = true;
+		if (strcmp(argv[i], "--record") == 0) recordPath = argv[i + 1];
+	}
 	InitWindow(GetMonitorWidth(0), GetMonitorHeight(0), "Defence Of The Base");
 	ToggleFullscreen();
 	int screenWidth = GetScreenWidth();
 	int screenHeight = GetScreenHeight();
-	Vector2 playerPos = {100.0f, 100.0f};
 	scale = screenHeight / 720.0f;
 	SetTargetFPS(60);
-	std::vector<std::vector<int>> map(mapHeight, std::vector<int>(mapWidth, 0));
-	GenerateIsolatedResources(map, 1, 50);
-	GenerateIsolatedResources(map, 2, 40);
-	GenerateIsolatedResources(map, 3, 30);
-	int cpCount = 0;
-	int *cp = LoadCodepoints(chars, &cpCount);
-	Font font = LoadFontEx("fonts/Ubuntu-R.ttf", 128, cp, cpCount);
+	FontSet font;
+	font.Init("fonts/Ubuntu-R.ttf", chars);
 	camera.target = Vector2{(float)screenWidth / 2.0f, (float)screenHeight / 2.0f};
 	camera.offset = camera.target;
 	camera.zoom = 1.0f;
-	const int dxs[4] = {-1, 1, 0, 0};
-	const int dys[4] = {0, 0, -1, 1};
+	saveWriter.Start();
 	while (!WindowShouldClose()) {
+#ifdef ENABLE_PROFILER
+		ProfilerBeginFrame();
+#endif
 		BeginDrawing();
 		ClearBackground(DARKGRAY);
 		float titleSize = 100 * scale;
@@ -297,57 +757,57 @@ int main() {
 		float btnYOffset = btnHeight + spacing;
 		if (currentState == STATE_MENU) {
 			float btnX = (screenWidth - btnWidth) / 18.0f;
-			Vector2 titlePos = {(screenWidth - MeasureTextEx(font, t("title").c_str(), titleSize, 1).x) / 2.0f, startY - 100};
+			Vector2 titlePos = {(screenWidth - MeasureTextEx(font, t(TXT_TITLE), titleSize, 1).x) / 2.0f, startY - 100};
 			Vector2 titlePos1 = {(screenWidth - MeasureTextEx(font, "RGR1909", titleSize, 1).x) + 225.0f, startY + 450.0f};
-			DrawTextEx(font, t("title").c_str(), titlePos, titleSize, 1, WHITE);
+			DrawTextEx(font, t(TXT_TITLE), titlePos, titleSize, 1, WHITE);
 			DrawTextEx(font, "RGR1909", titlePos1, titleSize / 4.0f, 1, WHITE);
 			Rectangle play = {20, 240, 300, 70};
 			Rectangle continue1 = {20, 330, 300, 70};
 			Rectangle setting = {20, 420, 300, 70};
 			Rectangle quit = {20, 510, 300, 70};
-			if (CheckButton(play, t("play").c_str(), font, 2)) {
-				NewGame(map);
+			if (CheckButton(play, t(TXT_PLAY), font, 2)) {
+				LoadGameAssets(screenWidth, screenHeight);
+				NewGame();
+				BeginSession();
+				terrain.Reset(world.width, world.height);
+				buildingRenderer.Reset(world.width, world.height);
+				minimap.Reset(world.width, world.height);
 				currentState = STATE_GAME;
 			}
-			if (CheckButton(continue1, t("continue").c_str(), font, 2)) currentState = STATE_CONTINUE;
-			if (CheckButton(setting, t("settings").c_str(), font, 2)) currentState = STATE_SETTING;
-			if (CheckButton(quit, t("exit").c_str(), font, 2)) break;
+			if (CheckButton(continue1, t(TXT_CONTINUE), font, 2)) currentState = STATE_CONTINUE;
+			if (CheckButton(setting, t(TXT_SETTINGS), font, 2)) currentState = STATE_SETTING;
+			if (CheckButton(quit, t(TXT_EXIT), font, 2)) break;
 		}
 		else if (currentState == STATE_CONTINUE) {
-			LoadGame(map);
+			LoadGameAssets(screenWidth, screenHeight);
+			if (!LoadGame()) NewGame();
+			BeginSession();
+			terrain.Reset(world.width, world.height);
+			buildingRenderer.Reset(world.width, world.height);
+			minimap.Reset(world.width, world.height);
 			currentState = STATE_GAME;
 		}
 		else if (currentState == STATE_SETTING) {
 			float btnX = (screenWidth - btnWidth) / 18.0f;
 			static bool musicOn = true;
 			static bool sfxOn = true;
-			static int langIndex = 0;
-			std::vector<std::string> langList = {"ua", "en"};
-			Vector2 titlePos = {(screenWidth - MeasureTextEx(font, t("Setting").c_str(), titleSize, 1).x) / 2.0f, startY - 100};
-			DrawTextEx(font, t("Setting").c_str(), titlePos, titleSize, 1, WHITE);
+			Vector2 titlePos = {(screenWidth - MeasureTextEx(font, t(TXT_SETTING_TITLE), titleSize, 1).x) / 2.0f, startY - 100};
+			DrawTextEx(font, t(TXT_SETTING_TITLE), titlePos, titleSize, 1, WHITE);
 			Rectangle musicBtn = {20, 135, 200, 50};
-			if (CheckButton(musicBtn, musicOn ? t("music_on").c_str() : t("music_off").c_str(), font, 1)) 
+			if (CheckButton(musicBtn, musicOn ? t(TXT_MUSIC_ON) : t(TXT_MUSIC_OFF), font, 1)) 
 				musicOn = !musicOn;
 			Rectangle sfxBtn = {240, 135, 200, 50};
-			if (CheckButton(sfxBtn, sfxOn ? t("sfx_on").c_str() : t("sfx_off").c_str(), font, 1)) 
+			if (CheckButton(sfxBtn, sfxOn ? t(TXT_SFX_ON) : t(TXT_SFX_OFF), font, 1)) 
 				sfxOn = !sfxOn;
 			Rectangle langBtn = {460, 135, 200, 50};
-			if (CheckButton(langBtn, currentLanguage == "en" ? "Language: English" : "Мова: Українська", font, 1)) {
-				langIndex = (langIndex + 1) % langList.size();
-				currentLanguage = langList[langIndex];
-			}
+			if (CheckButton(langBtn, t(TXT_LANGUAGE), font, 1))
+				language = language == english ? ukrainian : english;
 			Rectangle backBtn = {410, 525, 200, 50};
-			if (CheckButton(backBtn, t("back").c_str(), font, 1)) currentState = STATE_MENU;
+			if (CheckButton(backBtn, t(TXT_BACK), font, 1)) currentState = STATE_MENU;
 		}
 		else if (currentState == STATE_GAME) {
-			timer += GetFrameTime() * timeSpeed;
-			float adjustedDelta = GetFrameTime() * timeSpeed;
-			gameTime += adjustedDelta;
-			if (gameTime >= 24.0f) gameTime -= 24.0f;
-			resourceTimer += adjustedDelta;
-			playerPos.x += playerSpeed * adjustedDelta;
-			timeOfDay += adjustedDelta * 0.05f; 
-			if (timeOfDay > 1.0f) timeOfDay -= 1.0f;
+			const WorldSnapshot &snapshot = sim.Acquire();
+			float gameTime = snapshot.gameTime;
 			float brightness = 1.0f;
 			float nightFade = 0.0f;
 			if (gameTime >= 23.0f || gameTime < 6.0f) {
@@ -369,24 +829,24 @@ int main() {
 				brightness = 1.0f;
 				nightFade = 0.0f;
 			}
-			if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) { dragStart = GetMousePosition(); dragging = true; }
+			// M toggles the minimap; pressing on it moves the view there instead of starting a pan.
+			if (IsKeyPressed(KEY_M)) minimap.visible = !minimap.visible;
+			Rectangle minimapBounds = minimap.Bounds(screenWidth, 200 * scale);
+			bool overMinimap = minimap.visible && CheckCollisionPointRec(GetMousePosition(), minimapBounds);
+			if (overMinimap && !dragging && IsMouseButtonDown(MOUSE_LEFT_BUTTON))
+				camera.target = minimap.WorldAt(minimapBounds, GetMousePosition());
+			if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON) && !overMinimap) { dragStart = GetMousePosition(); dragging = true; }
 			if (IsMouseButtonDown(MOUSE_LEFT_BUTTON) && dragging) {
 				Vector2 cur = GetMousePosition();
 				camera.target = Vector2Add(camera.target, Vector2Subtract(dragStart, cur));
 				dragStart = cur;
 			}
 			if (IsMouseButtonReleased(MOUSE_LEFT_BUTTON)) dragging = false;
-			camera.zoom = Clamp(camera.zoom + GetMouseWheelMove() * 0.1f, 0.5f, 3.0f);
-			UpdateConnections();
-			BeginMode2D(camera);
-			for (int y = 0; y < mapHeight; y++)
-				for (int x = 0; x < mapWidth; x++) {
-					Vector2 pos = {(float)x * tileSize, (float)y * tileSize};
-					DrawRectangleV(pos, {tileSize - 2, tileSize - 2}, LIGHTGRAY);
-					if (map[y][x] == 1) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, GREEN);
-					if (map[y][x] == 2) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, GOLD); 
-					if (map[y][x] == 3) DrawCircle(pos.x + tileSize / 2, pos.y + tileSize / 2, 15, DARKGRAY);
-				}
+			camera.zoom = Clamp(camera.zoom + GetMouseWheelMove() * 0.1f, minZoom, maxZoom);
+			Vector2 viewMin = GetScreenToWorld2D({0, 0}, camera);
+			Vector2 viewMax = GetScreenToWorld2D({(float)screenWidth, (float)screenHeight}, camera);
+			Rectangle view = {viewMin.x, viewMin.y, viewMax.x - viewMin.x, viewMax.y - viewMin.y};
+			terrain.Prepare(snapshot, view);
 			Color dayColor = {
 				(unsigned char)(brightness * 80), 
 				(unsigned char)(brightness * 80), 
@@ -394,90 +854,54 @@ int main() {
 				255
 			};
 			ClearBackground(dayColor);
+			BeginMode2D(camera);
+			terrain.Draw(view);
 			Color tint = {0, 0, 0, (unsigned char)(nightFade * 150)};
 			DrawRectangleV(
 				{camera.target.x - screenWidth / (2 * camera.zoom), camera.target.y - screenHeight / (2 * camera.zoom)},
 				{(float)screenWidth / camera.zoom, (float)screenHeight / camera.zoom},
 				tint
 			);
-			for (auto &a : buildings)
-				for (auto &b : buildings) {
-					if (&a == &b) continue;
-					int idxA = PosToIndex(a.x, a.y), idxB = PosToIndex(b.x, b.y);
-					if (!connected.count(idxA) || !connected.count(idxB)) continue;
-					int dist = abs(a.x - b.x) + abs(a.y - b.y);
-					bool valid = false;
-					if ((a.type == BUILD_ARCHER && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_ARCHER && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_BASE && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_BASE && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_CANNON && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_CANNON && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_FACTORY && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_FACTORY && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_GOLD_MINE && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_GOLD_MINE && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_IRON_MINE && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_IRON_MINE && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if ((a.type == BUILD_SAWMILL && b.type == BUILD_TRANSPORTER) || (b.type == BUILD_SAWMILL && a.type == BUILD_TRANSPORTER)) {
-						valid = dist <= 5;
-					}
-					else if (a.type == BUILD_TRANSPORTER && b.type == BUILD_TRANSPORTER) {
-						valid = dist <= 5;
-					}
-					if (valid) {
-						Vector2 p1 = {(float)a.x * tileSize + tileSize / 2, (float)a.y * tileSize + tileSize / 2};
-						Vector2 p2 = {(float)b.x * tileSize + tileSize / 2, (float)b.y * tileSize + tileSize / 2};
-						DrawLineV(p1, p2, Fade(LIME, 0.4f));
-					}
-				}
-			for (auto &b : buildings) {
-				float size = tileSize - 16;
-				Color col = WHITE;
-				switch (b.type) {
-					case BUILD_BASE: col = YELLOW; break;
-					case BUILD_GOLD_MINE: col = GOLD; break;
-					case BUILD_TRANSPORTER: col = SKYBLUE; size = (tileSize - 16) / 3.0f; break;
-					case BUILD_SAWMILL: col = BROWN; break;
-					case BUILD_ARCHER: col = PURPLE; break;
-					case BUILD_CANNON: col = RED; break;
-					case BUILD_IRON_MINE: col = GRAY; break;
-					case BUILD_FACTORY: col = GREEN; break;
+			{
+				PROFILE_SCOPE("power lines");
+				Color lineColor = Fade(LIME, 0.4f);
+				for (auto &e : snapshot.edges) {
+					Vector2 p1 = {(float)(e.first % snapshot.width) * tileSize + tileSize / 2, (float)(e.first / snapshot.width) * tileSize + tileSize / 2};
+					Vector2 p2 = {(float)(e.second % snapshot.width) * tileSize + tileSize / 2, (float)(e.second / snapshot.width) * tileSize + tileSize / 2};
+					DrawLineV(p1, p2, lineColor);
 				}
-				Vector2 pos = {
-					(float)b.x * tileSize + (tileSize - size) / 2, 
-					(float)b.y * tileSize + (tileSize - size) / 2 
-				};
-				DrawRectangle(pos.x, pos.y, size, size, col);
-				DrawRectangleLinesEx({pos.x, pos.y, size, size}, 4, BLACK);
-				if (b.type == BUILD_ARCHER && connected.count(PosToIndex(b.x, b.y))) {
-					Vector2 txt = {(float)b.x * tileSize + 10, (float)b.y * tileSize + 10};
-					DrawTextEx(font, "0", txt, 20, 1, WHITE);
+			}
+			buildingRenderer.Draw(snapshot, view, camera.zoom);
+			{
+				PROFILE_SCOPE("enemy draw");
+				for (size_t i = 0; i < snapshot.enemyX.size(); i++) {
+					Vector2 pos = {snapshot.enemyX[i] * tileSize, snapshot.enemyY[i] * tileSize};
+					if (!CheckCollisionPointRec(pos, view)) continue;
+					DrawRectangleV({pos.x - 6, pos.y - 6}, {12, 12}, MAROON);
 				}
-				if (b.type == BUILD_CANNON && connected.count(PosToIndex(b.x, b.y))) {
-					int ammo = cannonAmmo[PosToIndex(b.x, b.y)];
-					Vector2 txt = {(float)b.x * tileSize + 10, (float)b.y * tileSize + 10};
-						DrawTextEx(font, TextFormat("%d", ammo), txt, 20, 1, WHITE);
+			}
+			{
+				PROFILE_SCOPE("projectile draw");
+				for (size_t i = 0; i < snapshot.projectileX.size(); i++) {
+					Vector2 pos = {snapshot.projectileX[i] * tileSize, snapshot.projectileY[i] * tileSize};
+					if (!CheckCollisionPointRec(pos, view)) continue;
+					if (snapshot.projectileKind[i] == PROJECTILE_CANNONBALL) DrawRectangleV({pos.x - 4, pos.y - 4}, {8, 8}, BLACK);
+					else DrawRectangleV({pos.x - 2, pos.y - 2}, {4, 4}, BROWN);
 				}
 			}
 			EndMode2D();
+			if (minimap.visible) {
+				minimap.Update(snapshot);
+				minimap.Draw(minimapBounds, view);
+			}
 
+			PROFILE_SCOPE("ui");
 			Rectangle buildBar = {0, 475, 1100, 150};
 			DrawRectangleRec(buildBar, Fade(BLACK, 0.8f));
-			std::vector<std::string> labels = {
-				t("base"), t("gold_mine"), t("transporter"), t("sawmill"),
-				t("iron_mine"), t("cannon"), t("factory"), t("archer")
+			static const TextKey labels[8] = {
+				TXT_BASE, TXT_GOLD_MINE, TXT_TRANSPORTER, TXT_SAWMILL,
+				TXT_IRON_MINE, TXT_CANNON, TXT_FACTORY, TXT_ARCHER
 			};
-			const char* lbls[8];
-			for (int i = 0; i < 8; ++i) {
-				lbls[i] = labels[i].c_str();
-			}
 			Rectangle customButtons[8] = {
 				{15, 500, 140, 40},  	// base
 				{170, 500, 140, 40}, 	// gold_mine
@@ -490,156 +914,113 @@ int main() {
 			};
 			for (int i = 0; i < 8; i++) {
 				Rectangle btn = customButtons[i];
-				bool disabled = (!basePlaced && i != 0) || (i == 0 && basePlaced);
+				bool disabled = !snapshot.basePlaced && i != 0;
 				Color frame = disabled ? DARKGRAY : (selectedBuild == i + 1 ? YELLOW : WHITE);
-				if (!disabled && CheckButton(btn, lbls[i], font, 1)) {
+				if (!disabled && CheckButton(btn, t(labels[i]), font, 1)) {
 					selectedBuild = i + 1;
 				}
 				DrawRectangleLinesEx(btn, 3.0f * scale, frame);
 				if (disabled) DrawRectangleRec(btn, Fade(BLACK, 0.6f));
 			}
 			Rectangle menuBtn = {945, 5, 70, 30};
-			if (CheckButton(menuBtn, t("menu").c_str(), font, 1)) currentState = STATE_MENU;
+			if (CheckButton(menuBtn, t(TXT_MENU), font, 1)) {
+				EndSession();
+				currentState = STATE_MENU;
+			}
 			static bool deleteMode = false;
 			Rectangle delBtn = {785, 5, 150, 30};
-			if (CheckButton(delBtn, deleteMode ? t("delete_on").c_str() : t("delete_off").c_str(), font, 1))
+			if (CheckButton(delBtn, deleteMode ? t(TXT_DELETE_ON) : t(TXT_DELETE_OFF), font, 1))
 				deleteMode = !deleteMode;
-			if (deleteMode && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-				Vector2 w = GetScreenToWorld2D(GetMousePosition(), camera);
-				int tx = w.x / tileSize, ty = w.y / tileSize;
-				for (int i = 0; i < buildings.size(); i++) {
-					if (buildings[i].x == tx && buildings[i].y == ty && buildings[i].type != BUILD_BASE) {
-						buildings.erase(buildings.begin() + i);
-						break;
-					}
-				}
-			}
+			Rectangle targetBtn = {625, 5, 150, 30};
+			if (CheckButton(targetBtn, t((TextKey)(TXT_TARGET_NEAREST + snapshot.targetPolicy)), font, 1))
+				Issue({0, CMD_TARGET_POLICY, BUILD_NONE, (snapshot.targetPolicy + 1) % TARGET_POLICIES, 0, 0.0f});
 			int hour = (int)(gameTime);
 			int minutes = (int)((gameTime - hour) * 60.0f);
 			DrawText(TextFormat("%02d:%02d", hour, minutes), 455, 30, 40, WHITE);
 			Rectangle pauseBtn = {785, 40, 70, 30};
-			Rectangle speed1xBtn = {865, 40, 70, 30};
-			Rectangle speed3xBtn = {945, 40, 70, 30};
-			if (CheckButton(pauseBtn, t("pause").c_str(), font, 1)) timeSpeed = 0.0f;
-			if (CheckButton(speed1xBtn, "1x", font, 1)) timeSpeed = 1.0f;
-			if (CheckButton(speed3xBtn, "3x", font, 1)) timeSpeed = 3.0f;
-			if (!deleteMode && selectedBuild != BUILD_NONE && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-				Vector2 w = GetScreenToWorld2D(GetMousePosition(), camera);
-				int tx = w.x / tileSize, ty = w.y / tileSize;
-				if (IsInsideMap(tx, ty)) {
-					bool free = true;
-					for (auto &bb : buildings) 
-						if (bb.x == tx && bb.y == ty) 
-							free = false;
-					bool ok = free && map[ty][tx] == 0;
-					if (selectedBuild == BUILD_BASE && basePlaced)
-						ok = false;
-					if (ok) {
-						if (selectedBuild == BUILD_GOLD_MINE) {
-							bool nearGold = false;
-							for (int d = 0; d < 4; d++) {
-								int nx = tx + dxs[d];
-								int ny = ty + dys[d];
-									if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 2)
-										nearGold = true;
-							}
-							ok = nearGold;
-						}
-						if (selectedBuild == BUILD_SAWMILL) {
-							bool nearTree = false;
-							for (int d = 0; d < 4; d++) {
-								int nx = tx + dxs[d];
-								int ny = ty + dys[d];
-									if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 1)
-										nearTree = true;
-							}
-							ok = nearTree;
-						}
-						if (selectedBuild == BUILD_IRON_MINE) {
-							bool nearIron = false;
-							for (int d = 0; d < 4; d++) {
-								int nx = tx + dxs[d];
-								int ny = ty + dys[d];
-									if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 3)
-										nearIron = true;
-							}
-							ok = nearIron;
-						}
-						if (ok) {
-							buildings.push_back({(BuildingType)selectedBuild, tx, ty});
-							if (selectedBuild == BUILD_BASE) 
-								basePlaced = true;
-						}
-					}
-				}
+			if (CheckButton(pauseBtn, t(TXT_PAUSE), font, 1)) Issue({0, CMD_SPEED, BUILD_NONE, 0, 0, 0.0f});
+			static const float speeds[5] = {1.0f, 3.0f, 10.0f, 100.0f, 1000.0f};
+			static const char *speedLabels[5] = {"1x", "3x", "10x", "100x", "1000x"};
+			static const Rectangle speedButtons[5] = {
+				{865, 40, 70, 30}, {945, 40, 70, 30},
+				{785, 75, 70, 30}, {865, 75, 70, 30}, {945, 75, 70, 30}
+			};
+			for (int i = 0; i < 5; i++)
+				if (CheckButton(speedButtons[i], speedLabels[i], font, 1)) Issue({0, CMD_SPEED, BUILD_NONE, 0, 0, speeds[i]});
+			if (caughtUpNotice > 0.0f) {
+				caughtUpNotice -= GetFrameTime();
+				DrawTextEx(font, TextFormat(t(TXT_CAUGHT_UP), caughtUpHours), {455, 80}, 20, 1, WHITE);
 			}
-            if (timer >= 1.0f) {
-                for (auto &b : buildings) {
-                    int idx = PosToIndex(b.x, b.y);
-                    if (!connected.count(idx)) continue;
-                    if (b.type == BUILD_GOLD_MINE) {
-                        bool nearGold = false;
-                        for (int d = 0; d < 4; d++) {
-							int nx = b.x + dxs[d];
-							int ny = b.y + dys[d];
-                                if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 2)
-                                    nearGold = true;
-                        }
-                        if (nearGold) gold += 5;
-                    }
-                    if (b.type == BUILD_SAWMILL) {
-                        bool nearTree = false;
-                        for (int d = 0; d < 4; d++) {
-							int nx = b.x + dxs[d];
-							int ny = b.y + dys[d];
-                                if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 1)
-                                    nearTree = true;
-                        }
-						if (nearTree) tree += 2;
-                    }
-                    if (b.type == BUILD_IRON_MINE) {
-                        bool nearIron = false;
-                        for (int d = 0; d < 4; d++) {
-							int nx = b.x + dxs[d];
-							int ny = b.y + dys[d];
-								if (nx >= 0 && nx < mapWidth && ny >= 0 && ny < mapHeight && map[ny][nx] == 3)
-									nearIron = true;
-						}
-						if (nearIron) iron += 1;
-					}
-				}
-				for (auto &b : buildings) {
-					int idx = PosToIndex(b.x, b.y);
-					if (!connected.count(idx)) continue;
-					if (b.type == BUILD_FACTORY) {
-						if (iron > 0) {
-							iron--;
-							ammoCore++;
-						}
-					}
-					if (b.type == BUILD_CANNON) {
-						if (!connected.count(idx)) cannonAmmo[idx] = 0;
-						while (cannonAmmo[idx] < 20 && ammoCore > 0) {
-							cannonAmmo[idx]++;
-							ammoCore--;
-						}
-					}
-				}
-				timer -= 1.0f;
+			if (badSaveNotice > 0.0f) {
+				badSaveNotice -= GetFrameTime();
+				DrawTextEx(font, TextFormat(t(TXT_BAD_SAVE), badSavePath), {455, 80}, 20, 1, ORANGE);
+			}
+			// Right-dragging lays a line along the longer axis, or with Shift a filled rectangle, as one command;
+			// in delete mode it clears the same area. A click acts on a single tile, and bases always do.
+			static bool areaDrag = false;
+			static int areaX = 0, areaY = 0;
+			bool building = deleteMode || selectedBuild != BUILD_NONE;
+			Vector2 w = GetScreenToWorld2D(GetMousePosition(), camera);
+			int tx = w.x / tileSize, ty = w.y / tileSize;
+			if (building && !overMinimap && IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
+				areaDrag = true;
+				areaX = tx;
+				areaY = ty;
+			}
+			if (!IsKeyDown(KEY_LEFT_SHIFT)) {
+				if (abs(tx - areaX) >= abs(ty - areaY)) ty = areaY;
+				else tx = areaX;
 			}
+			if (!building || (!deleteMode && selectedBuild == BUILD_BASE)) {
+				tx = areaX;
+				ty = areaY;
+			}
+			if (areaDrag) {
+				Vector2 from = GetWorldToScreen2D({(float)std::min(areaX, tx) * tileSize, (float)std::min(areaY, ty) * tileSize}, camera);
+				Vector2 to = GetWorldToScreen2D({(float)(std::max(areaX, tx) + 1) * tileSize, (float)(std::max(areaY, ty) + 1) * tileSize}, camera);
+				Rectangle area = {from.x, from.y, to.x - from.x, to.y - from.y};
+				Color tint = deleteMode ? RED : GREEN;
+				DrawRectangleRec(area, Fade(tint, 0.25f));
+				DrawRectangleLinesEx(area, 2.0f, tint);
+			}
+			if (areaDrag && IsMouseButtonReleased(MOUSE_RIGHT_BUTTON)) {
+				areaDrag = false;
+				bool single = tx == areaX && ty == areaY;
+				if (deleteMode) Issue({0, single ? CMD_REMOVE : CMD_REMOVE_AREA, BUILD_NONE, areaX, areaY, 0.0f, tx, ty});
+				else if (building) Issue({0, single ? CMD_PLACE : CMD_PLACE_AREA, (BuildingType)selectedBuild, areaX, areaY, 0.0f, tx, ty});
+			}
+			if (IsKeyDown(KEY_LEFT_CONTROL) && IsKeyPressed(KEY_Z))
+				Issue({0, IsKeyDown(KEY_LEFT_SHIFT) ? CMD_REDO : CMD_UNDO, BUILD_NONE, 0, 0, 0.0f});
+			if (IsKeyDown(KEY_LEFT_CONTROL) && IsKeyPressed(KEY_Y)) Issue({0, CMD_REDO, BUILD_NONE, 0, 0, 0.0f});
 			float resFontSize = 30 * scale;
 			float resSpacing = resFontSize + 10 * scale;
 			float x =10, y = 10;
-			DrawTextEx(font, TextFormat("%s: %d", t("gold").c_str(), gold), {x, y}, resFontSize + 15, 2, RED);
-			DrawTextEx(font, TextFormat("%s: %d", t("tree").c_str(), tree), {x, y + 40}, resFontSize, 1, RED);
-			DrawTextEx(font, TextFormat("%s: %d", t("iron").c_str(), iron), {x, y + 70}, resFontSize, 3, RED);
-			DrawTextEx(font, TextFormat("%s: %d", t("ammoCore").c_str(), ammoCore), {x, y + 100}, resFontSize, 4, RED);
+			DrawTextEx(font, TextFormat("%s: %d", t(TXT_GOLD), snapshot.gold), {x, y}, resFontSize + 15, 2, RED);
+			DrawTextEx(font, TextFormat("%s: %d", t(TXT_TREE), snapshot.tree), {x, y + 40}, resFontSize, 1, RED);
+			DrawTextEx(font, TextFormat("%s: %d", t(TXT_IRON), snapshot.iron), {x, y + 70}, resFontSize, 3, RED);
+			DrawTextEx(font, TextFormat("%s: %d", t(TXT_AMMO_CORE), snapshot.ammoCore), {x, y + 100}, resFontSize, 4, RED);
+			DrawTextEx(font, TextFormat("%s: %d/%d", t(TXT_BASE), snapshot.baseHealth, baseMaxHealth), {x, y + 130}, resFontSize, 1, RED);
+			DrawTextEx(font, TextFormat("%s: %d", t(TXT_WAVE), snapshot.wave), {x, y + 160}, resFontSize, 1, RED);
 		}
-		SaveGame(map);
-		EndDrawing();
+#ifdef ENABLE_PROFILER
+		DrawProfiler(font);
+#endif
+		{
+			PROFILE_SCOPE("present");
+			EndDrawing();
+		}
+#ifdef ENABLE_PROFILER
+		ProfilerEndFrame();
+#endif
+	}
+	if (currentState == STATE_GAME) EndSession();
+	saveWriter.Stop();
+	font.Unload();
+	if (gameAssetsLoaded) {
+		terrain.Unload();
+		buildingRenderer.Unload();
 	}
-	UnloadCodepoints(cp);
-	UnloadFont(font);
+	minimap.Unload();
 	CloseWindow();
 	return 0;
 }
@@ -0,0 +1,155 @@
+#include "profiler.h"
+
+#ifdef ENABLE_PROFILER
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Scopes may close on any thread (the simulation runs on its own), so per-frame totals are atomic and
+// registration and capture take a lock.
+struct Phase {
+	const char *name;
+	float history[profileHistory];
+	std::atomic<long long> frameNs;
+};
+
+struct Event {
+	int phase, thread;
+	long long startUs, durationUs;
+};
+
+// Caps a capture at a few minutes of a busy frame loop.
+const size_t maxCaptureEvents = 1 << 20;
+
+Phase phases[maxProfilePhases];
+std::atomic<int> phaseCount{0};
+int frame = 0;
+std::mutex lock;
+std::atomic<bool> capturing{false};
+Clock::time_point captureStart;
+std::vector<Event> events;
+std::atomic<int> threadCount{0};
+thread_local int traceThread = ++threadCount;
+
+struct Counter {
+	const char *name;
+	std::atomic<long long> value;
+};
+
+Counter counters[maxProfileCounters];
+std::atomic<int> counterCount{0};
+
+}
+
+int ProfilerPhase(const char *name) {
+	std::lock_guard<std::mutex> guard(lock);
+	int count = phaseCount;
+	for (int i = 0; i < count; i++)
+		if (strcmp(phases[i].name, name) == 0) return i;
+	if (count == maxProfilePhases) return maxProfilePhases - 1;
+	phases[count].name = name;
+	phases[count].frameNs = 0;
+	phaseCount = count + 1;
+	return count;
+}
+
+ProfileScope::~ProfileScope() {
+	Clock::time_point end = Clock::now();
+	phases[phase].frameNs += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+	if (capturing) {
+		auto us = [](Clock::duration d) { return (long long)std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+		std::lock_guard<std::mutex> guard(lock);
+		if (capturing && events.size() < maxCaptureEvents)
+			events.push_back({phase, traceThread, us(start - captureStart), us(end - start)});
+	}
+}
+
+void ProfilerBeginFrame() {
+	for (int i = 0; i < phaseCount; i++) phases[i].frameNs = 0;
+}
+
+void ProfilerEndFrame() {
+	for (int i = 0; i < phaseCount; i++) phases[i].history[frame % profileHistory] = phases[i].frameNs / 1e6f;
+	frame++;
+}
+
+int ProfilerStats(PhaseStats *out, int capacity) {
+	int frames = std::min(frame, profileHistory);
+	int n = std::min(phaseCount.load(), capacity);
+	float sorted[profileHistory];
+	for (int i = 0; i < n; i++) {
+		std::copy(phases[i].history, phases[i].history + frames, sorted);
+		std::sort(sorted, sorted + frames);
+		float sum = 0.0f;
+		for (int f = 0; f < frames; f++) sum += sorted[f];
+		out[i].name = phases[i].name;
+		out[i].minMs = frames ? sorted[0] : 0.0f;
+		out[i].avgMs = frames ? sum / frames : 0.0f;
+		out[i].p99Ms = frames ? sorted[std::min(frames - 1, frames * 99 / 100)] : 0.0f;
+	}
+	return n;
+}
+
+int ProfilerCounter(const char *name) {
+	std::lock_guard<std::mutex> guard(lock);
+	int count = counterCount;
+	for (int i = 0; i < count; i++)
+		if (strcmp(counters[i].name, name) == 0) return i;
+	if (count == maxProfileCounters) return maxProfileCounters - 1;
+	counters[count].name = name;
+	counters[count].value = 0;
+	counterCount = count + 1;
+	return count;
+}
+
+void ProfilerSetCounter(int counter, long long value) { counters[counter].value = value; }
+
+int ProfilerCounters(CounterValue *out, int capacity) {
+	int n = std::min(counterCount.load(), capacity);
+	for (int i = 0; i < n; i++) out[i] = {counters[i].name, counters[i].value};
+	return n;
+}
+
+void ProfilerStartCapture() {
+	std::lock_guard<std::mutex> guard(lock);
+	events.clear();
+	events.reserve(maxCaptureEvents);
+	captureStart = Clock::now();
+	capturing = true;
+}
+
+bool ProfilerCapturing() { return capturing; }
+
+bool ProfilerStopCapture(const char *path) {
+	std::lock_guard<std::mutex> guard(lock);
+	capturing = false;
+	char name[512];
+	snprintf(name, sizeof(name), "%s.json", path);
+	FILE *trace = fopen(name, "w");
+	snprintf(name, sizeof(name), "%s.csv", path);
+	FILE *csv = fopen(name, "w");
+	if (trace) {
+		fprintf(trace, "{\"traceEvents\":[\n");
+		for (size_t i = 0; i < events.size(); i++)
+			fprintf(trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld}\n",
+				i ? "," : "", phases[events[i].phase].name, events[i].thread, events[i].startUs, events[i].durationUs);
+		fprintf(trace, "]}\n");
+		fclose(trace);
+	}
+	if (csv) {
+		fprintf(csv, "phase,thread,start_us,duration_us\n");
+		for (const Event &e : events)
+			fprintf(csv, "%s,%d,%lld,%lld\n", phases[e.phase].name, e.thread, e.startUs, e.durationUs);
+		fclose(csv);
+	}
+	events = std::vector<Event>();
+	return trace && csv;
+}
+#endif
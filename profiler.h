@@ -0,0 +1,67 @@
+#pragma once
+
+// Scoped frame profiler. Only built with -DENABLE_PROFILER; without it PROFILE_SCOPE expands to nothing and
+// profiler.cpp compiles to an empty unit, so release builds pay nothing.
+//
+//     PROFILE_SCOPE("terrain draw");   // times the rest of the enclosing block as one phase
+//     PROFILE_COUNTER("enemies", n);    // reports the latest value of a named counter
+//
+// Each phase keeps the total time it took per frame over the last profileHistory frames. While a capture
+// is running every scope is also recorded as an event and written out as a Chrome trace and a CSV file.
+
+#ifdef ENABLE_PROFILER
+#include <chrono>
+
+const int profileHistory = 240;
+const int maxProfilePhases = 32;
+const int maxProfileCounters = 16;
+
+struct PhaseStats {
+	const char *name;
+	float minMs, avgMs, p99Ms;
+};
+
+// Returns the slot for a phase name; the name must outlive the program (a string literal).
+int ProfilerPhase(const char *name);
+void ProfilerBeginFrame();
+void ProfilerEndFrame();
+// Fills `out` with the stats of every phase seen so far and returns how many there are.
+int ProfilerStats(PhaseStats *out, int capacity);
+
+struct CounterValue {
+	const char *name;
+	long long value;
+};
+
+// Counters report the last value set, such as how many objects are alive. Names work as for phases.
+int ProfilerCounter(const char *name);
+void ProfilerSetCounter(int counter, long long value);
+int ProfilerCounters(CounterValue *out, int capacity);
+
+// Recording starts empty; stopping writes `path`.json (chrome://tracing) and `path`.csv.
+void ProfilerStartCapture();
+bool ProfilerStopCapture(const char *path);
+bool ProfilerCapturing();
+
+struct ProfileScope {
+	int phase;
+	std::chrono::steady_clock::time_point start;
+
+	explicit ProfileScope(int phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+	~ProfileScope();
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) \
+	static const int PROFILE_CONCAT(profilePhase, __LINE__) = ProfilerPhase(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profilePhase, __LINE__))
+#define PROFILE_COUNTER(name, value) \
+	do { \
+		static const int profileCounter = ProfilerCounter(name); \
+		ProfilerSetCounter(profileCounter, value); \
+	} while (0)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNTER(name, value) do {} while (0)
+#endif
@@ -0,0 +1,69 @@
+#include "projectiles.h"
+#include <algorithm>
+#include <cmath>
+
+Projectiles::Projectiles()
+	: x(maxProjectiles), y(maxProjectiles), vx(maxProjectiles), vy(maxProjectiles), timeLeft(maxProjectiles),
+	  kind(maxProjectiles), alive(maxProjectiles), sequence(maxProjectiles), freeSlots(maxProjectiles) {
+	Clear();
+}
+
+void Projectiles::Clear() {
+	std::fill(vx.begin(), vx.begin() + highWater, 0.0f);
+	std::fill(vy.begin(), vy.begin() + highWater, 0.0f);
+	std::fill(timeLeft.begin(), timeLeft.begin() + highWater, 0.0f);
+	std::fill(alive.begin(), alive.begin() + highWater, 0);
+	// Slot 0 ends up on top, so a fresh pool fills from the bottom.
+	for (int i = 0; i < maxProjectiles; i++) freeSlots[i] = maxProjectiles - 1 - i;
+	freeCount = maxProjectiles;
+	highWater = 0;
+	live = 0;
+	peak = 0;
+	nextSequence = 0;
+}
+
+int Projectiles::Spawn(ProjectileKind type, float fromX, float fromY, float toX, float toY, float tilesPerHour) {
+	if (freeCount == 0) return -1;
+	int i = freeSlots[--freeCount];
+	float dx = toX - fromX, dy = toY - fromY;
+	float dist = std::sqrt(dx * dx + dy * dy);
+	x[i] = fromX;
+	y[i] = fromY;
+	vx[i] = dist > 0.0f ? dx / dist * tilesPerHour : 0.0f;
+	vy[i] = dist > 0.0f ? dy / dist * tilesPerHour : 0.0f;
+	timeLeft[i] = dist / tilesPerHour;
+	kind[i] = type;
+	alive[i] = 1;
+	sequence[i] = nextSequence++;
+	highWater = std::max(highWater, (size_t)i + 1);
+	live++;
+	peak = std::max(peak, live);
+	return i;
+}
+
+void Projectiles::Release(size_t i) {
+	vx[i] = vy[i] = timeLeft[i] = 0.0f;
+	alive[i] = 0;
+	freeSlots[freeCount++] = (int)i;
+	live--;
+	while (highWater > 0 && !alive[highWater - 1]) highWater--;
+}
+
+void Projectiles::InOrder(std::vector<int> &slots) const {
+	slots.clear();
+	for (size_t i = 0; i < highWater; i++)
+		if (alive[i]) slots.push_back((int)i);
+	std::sort(slots.begin(), slots.end(), [&](int a, int b) { return sequence[a] < sequence[b]; });
+}
+
+// Moves every slot below highWater, free ones included since they do not move; a shot stops where it lands.
+void Projectiles::Move(float dt) {
+	float *px = x.data(), *py = y.data(), *left = timeLeft.data();
+	const float *pvx = vx.data(), *pvy = vy.data();
+	for (size_t i = 0; i < highWater; i++) {
+		float step = std::min(dt, left[i]);
+		px[i] += pvx[i] * step;
+		py[i] += pvy[i] * step;
+		left[i] -= step;
+	}
+}
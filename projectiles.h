@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+enum ProjectileKind : uint8_t { PROJECTILE_ARROW, PROJECTILE_CANNONBALL, PROJECTILE_KINDS };
+
+const int maxProjectiles = 1 << 16;
+
+// Shots in flight as parallel arrays in a fixed pool. Every array is sized to maxProjectiles up front and
+// free slots are kept on a stack, so spawning and releasing never allocate. Free slots have zero velocity
+// and no time left, which lets the move loop run over every slot below highWater without branching.
+// Positions are in tiles, velocities in tiles per game hour.
+struct Projectiles {
+	std::vector<float> x, y;
+	std::vector<float> vx, vy;
+	// Game hours until the shot lands.
+	std::vector<float> timeLeft;
+	std::vector<uint8_t> kind;
+	std::vector<uint8_t> alive;
+	// Spawn number, increasing, which orders impacts; the slot a shot gets depends on what was freed before
+	// it and is not kept by saves.
+	std::vector<uint64_t> sequence;
+
+	Projectiles();
+
+	size_t Live() const { return live; }
+	size_t Peak() const { return peak; }
+	// Slots below this may be alive; every slot at or above it is free.
+	size_t HighWater() const { return highWater; }
+	void Clear();
+	// Launches a shot from (fromX, fromY) landing on (toX, toY); returns its slot, or -1 if the pool is full.
+	int Spawn(ProjectileKind type, float fromX, float fromY, float toX, float toY, float tilesPerHour);
+	void Release(size_t i);
+	// Fills `slots` with the live shots in the order they were launched.
+	void InOrder(std::vector<int> &slots) const;
+
+	// Moves every shot `dt` game hours, then calls onImpact(kind, x, y) for each one that landed, in launch
+	// order, and frees it.
+	template <typename Fn>
+	void Advance(float dt, Fn onImpact) {
+		Move(dt);
+		landed.clear();
+		for (size_t i = 0; i < highWater; i++)
+			if (alive[i] && timeLeft[i] <= 0.0f) landed.push_back((int)i);
+		std::sort(landed.begin(), landed.end(), [&](int a, int b) { return sequence[a] < sequence[b]; });
+		for (int i : landed) {
+			onImpact((ProjectileKind)kind[i], x[i], y[i]);
+			Release(i);
+		}
+	}
+
+private:
+	std::vector<int> freeSlots;
+	std::vector<int> landed;
+	uint64_t nextSequence = 0;
+	size_t freeCount = 0;
+	size_t highWater = 0;
+	size_t live = 0, peak = 0;
+
+	void Move(float dt);
+};
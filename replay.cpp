@@ -0,0 +1,87 @@
+#include "replay.h"
+#include "bytes.h"
+#include <fstream>
+#include <iterator>
+
+static const char replayMagic[4] = {'D', 'O', 'T', 'R'};
+static const uint32_t replayVersion = 2;
+
+void Replay::Begin(const World &world) {
+	world.Serialize(start);
+	commands.clear();
+	endTick = 0;
+	endHash = 0;
+}
+
+void Replay::Record(const World &world, Command command) {
+	command.tick = world.ticks;
+	commands.push_back(command);
+}
+
+void Replay::Finish(const World &world) {
+	endTick = world.ticks;
+	endHash = world.StateHash();
+}
+
+bool Replay::Run(World &world) const {
+	if (!world.Deserialize(start)) return false;
+	size_t next = 0;
+	while (true) {
+		for (; next < commands.size() && commands[next].tick == world.ticks; next++)
+			world.Apply(commands[next]);
+		if (world.ticks >= endTick) break;
+		world.Tick(World::fixedStep);
+	}
+	return true;
+}
+
+bool WriteReplay(const char *path, const Replay &replay) {
+	std::vector<unsigned char> out(replayMagic, replayMagic + 4);
+	Put<uint32_t>(out, replayVersion);
+	Put<uint64_t>(out, replay.start.size());
+	out.insert(out.end(), replay.start.begin(), replay.start.end());
+	Put<uint64_t>(out, replay.endTick);
+	Put<uint64_t>(out, replay.endHash);
+	Put<uint32_t>(out, replay.commands.size());
+	for (const Command &c : replay.commands) {
+		Put<uint64_t>(out, c.tick);
+		Put<uint8_t>(out, c.kind);
+		Put<uint8_t>(out, c.type);
+		Put<int32_t>(out, c.x);
+		Put<int32_t>(out, c.y);
+		Put<float>(out, c.speed);
+		Put<int32_t>(out, c.toX);
+		Put<int32_t>(out, c.toY);
+	}
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	return (bool)file.write((const char *)out.data(), out.size());
+}
+
+bool ReadReplay(const char *path, Replay &replay) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) return false;
+	std::vector<unsigned char> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	size_t pos = 4;
+	uint32_t version, count;
+	uint64_t startSize;
+	if (in.size() < 4 || memcmp(in.data(), replayMagic, 4) != 0) return false;
+	// Version 1 predates the area commands and has no second corner.
+	if (!Get(in, pos, version) || version < 1 || version > replayVersion) return false;
+	if (!Get(in, pos, startSize) || startSize > in.size() - pos) return false;
+	replay.start.assign(in.begin() + pos, in.begin() + pos + startSize);
+	pos += startSize;
+	if (!Get(in, pos, replay.endTick) || !Get(in, pos, replay.endHash) || !Get(in, pos, count)) return false;
+	replay.commands.clear();
+	for (uint32_t i = 0; i < count; i++) {
+		Command c = {};
+		uint8_t kind, type;
+		if (!Get(in, pos, c.tick) || !Get(in, pos, kind) || !Get(in, pos, type)) return false;
+		if (!Get(in, pos, c.x) || !Get(in, pos, c.y) || !Get(in, pos, c.speed)) return false;
+		if (version >= 2 && (!Get(in, pos, c.toX) || !Get(in, pos, c.toY))) return false;
+		if (kind >= COMMAND_KINDS || type > BUILD_CANNON) return false;
+		c.kind = (CommandKind)kind;
+		c.type = (BuildingType)type;
+		replay.commands.push_back(c);
+	}
+	return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "world.h"
+#include <vector>
+#include <cstdint>
+
+// A recorded session: the world it started from and every player command with the tick it was issued on.
+// Feeding the commands back tick by tick from the same start reproduces the session exactly, so a long
+// game can be replayed headlessly in seconds and builds compared by run time and end-state hash.
+struct Replay {
+	std::vector<unsigned char> start;
+	std::vector<Command> commands;
+	uint64_t endTick = 0;
+	uint64_t endHash = 0;
+
+	void Begin(const World &world);
+	void Record(const World &world, Command command);
+	void Finish(const World &world);
+	// Runs the whole replay on `world` and returns false if the start state cannot be loaded.
+	bool Run(World &world) const;
+};
+
+bool WriteReplay(const char *path, const Replay &replay);
+bool ReadReplay(const char *path, Replay &replay);
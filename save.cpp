@@ -0,0 +1,106 @@
+#include "save.h"
+#include <fstream>
+#include <filesystem>
+#include <iterator>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const char *savePath = "save.dat";
+const char *badSavePath = "save.dat.bad";
+static const char *saveTempPath = "save.dat.tmp";
+
+// Flushes a written file through to the disk, so a crash after the rename cannot leave the save short.
+static bool SyncFile(FILE *file) {
+	if (fflush(file) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+// Makes the rename itself durable; the save lives in the working directory.
+static void SyncSaveDirectory() {
+#ifndef _WIN32
+	int dir = open(".", O_RDONLY);
+	if (dir < 0) return;
+	fsync(dir);
+	close(dir);
+#endif
+}
+
+void SaveWriter::Start() {
+	worker = std::thread([this] { Run(); });
+}
+
+void SaveWriter::Submit(std::vector<unsigned char> &snapshot) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.swap(snapshot);
+		hasPending = true;
+	}
+	wake.notify_one();
+}
+
+void SaveWriter::Stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_one();
+	if (worker.joinable()) worker.join();
+}
+
+void SaveWriter::Run() {
+	std::unique_lock<std::mutex> guard(lock);
+	while (true) {
+		wake.wait(guard, [this] { return hasPending || quit; });
+		if (!hasPending) break;
+		writing.swap(pending);
+		hasPending = false;
+		guard.unlock();
+		Write();
+		guard.lock();
+	}
+}
+
+void SaveWriter::Write() {
+	std::error_code error;
+	FILE *save = fopen(saveTempPath, "wb");
+	if (!save) return;
+	bool written = fwrite(writing.data(), 1, writing.size(), save) == writing.size() && SyncFile(save);
+	if (fclose(save) != 0 || !written) {
+		std::filesystem::remove(saveTempPath, error);
+		return;
+	}
+	std::filesystem::rename(saveTempPath, savePath, error);
+	if (error) std::filesystem::remove(saveTempPath, error);
+	else SyncSaveDirectory();
+}
+
+bool ReadSave(std::vector<unsigned char> &out) {
+	std::ifstream save(savePath, std::ios::binary);
+	if (!save.is_open()) return false;
+	out.assign(std::istreambuf_iterator<char>(save), std::istreambuf_iterator<char>());
+	return true;
+}
+
+bool SetAsideSave() {
+	std::error_code error;
+	std::filesystem::rename(savePath, badSavePath, error);
+	return !error;
+}
+
+double SaveAgeSeconds() {
+	std::error_code error;
+	auto written = std::filesystem::last_write_time(savePath, error);
+	if (error) return 0.0;
+	return std::max(std::chrono::duration<double>(std::filesystem::file_time_type::clock::now() - written).count(), 0.0);
+}
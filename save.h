@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+extern const char *savePath;
+// Where a save that failed to load is kept, out of the way of autosaves.
+extern const char *badSavePath;
+
+// Writes snapshots on a background thread. The game thread fills its own buffer and swaps it in, so it never
+// waits on the disk; each write goes to a temporary file that is synced to disk and then renamed over the
+// save, which keeps the previous save intact if the game or the machine dies mid-write.
+struct SaveWriter {
+	void Start();
+	void Submit(std::vector<unsigned char> &snapshot);
+	// Finishes any pending write before returning.
+	void Stop();
+
+private:
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::vector<unsigned char> pending;
+	std::vector<unsigned char> writing;
+	bool hasPending = false;
+	bool quit = false;
+
+	void Run();
+	void Write();
+};
+
+bool ReadSave(std::vector<unsigned char> &out);
+// Moves the save to badSavePath, replacing whatever was kept there before.
+bool SetAsideSave();
+// Real seconds since the save was last written, or 0 if there is none.
+double SaveAgeSeconds();
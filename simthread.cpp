@@ -0,0 +1,145 @@
+#include "simthread.h"
+#include "profiler.h"
+#include <chrono>
+
+bool CommandQueue::Push(const Command &command) {
+	unsigned t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) == commandQueueSize) return false;
+	items[t % commandQueueSize] = command;
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool CommandQueue::Pop(Command &command) {
+	unsigned h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire)) return false;
+	command = items[h % commandQueueSize];
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+void SimThread::Start(World &simWorld, SaveWriter &writer, Replay *replay) {
+	world = &simWorld;
+	saveWriter = &writer;
+	recording = replay;
+	autosaveTimer = 0.0f;
+	for (auto &b : buffers) {
+		b.width = world->width;
+		b.height = world->height;
+		b.tiles = world->tiles.data();
+		b.revision = world->revision - 1;
+	}
+	// Publish once up front so the first Acquire() already sees the world.
+	Publish();
+	running = true;
+	worker = std::thread([this] { Run(); });
+}
+
+void SimThread::Stop() {
+	running = false;
+	if (worker.joinable()) worker.join();
+	ApplyCommands();
+}
+
+const WorldSnapshot &SimThread::Acquire() {
+	if (middle.load(std::memory_order_acquire) & freshBit)
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~freshBit;
+	return buffers[front];
+}
+
+void SimThread::Run() {
+	using Clock = std::chrono::steady_clock;
+	const auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(World::fixedStep));
+	Clock::time_point last = Clock::now(), next = last;
+	while (running) {
+		Clock::time_point now = Clock::now();
+		float dt = std::chrono::duration<float>(now - last).count();
+		last = now;
+		ApplyCommands();
+		{
+			PROFILE_SCOPE("sim step");
+			world->Step(dt);
+		}
+		Autosave(dt);
+		Publish();
+		next = std::max(next + step, now);
+		std::this_thread::sleep_until(next);
+	}
+}
+
+void SimThread::ApplyCommands() {
+	Command command;
+	while (commands.Pop(command))
+		if (world->Apply(command) && recording) recording->Record(*world, command);
+}
+
+void SimThread::Autosave(float dt) {
+	autosaveTimer += dt;
+	if (!world->saveDirty || autosaveTimer < autosaveInterval) return;
+	PROFILE_SCOPE("save serialize");
+	world->Serialize(saveBuffer);
+	saveWriter->Submit(saveBuffer);
+	world->saveDirty = false;
+	autosaveTimer = 0.0f;
+}
+
+void SimThread::Publish() {
+	PROFILE_SCOPE("snapshot publish");
+	WorldSnapshot &s = buffers[back];
+	// Buildings, power and links only change on placement and removal; ammo and resources every economy tick.
+	if (s.revision != world->revision) {
+		s.buildings = world->Buildings();
+		s.powered = world->index.powered;
+		s.ammo.assign(s.buildings.size(), 0);
+		s.edges = world->powerGrid.Edges();
+		s.revision = world->revision;
+	}
+	TakeMarkChanges();
+	s.markChanges = journal;
+	s.markFirst = journalFirst;
+	const EconomyList &cannons = world->economy[ECON_CANNON];
+	for (size_t i = 0; i < cannons.tile.size(); i++)
+		s.ammo[world->index.occupancy[cannons.tile[i]]] = cannons.ammo[i];
+	s.enemyX = world->enemies.x;
+	s.enemyY = world->enemies.y;
+	const Projectiles &shots = world->projectiles;
+	s.projectileX.clear();
+	s.projectileY.clear();
+	s.projectileKind.clear();
+	for (size_t i = 0; i < shots.HighWater(); i++) {
+		if (!shots.alive[i]) continue;
+		s.projectileX.push_back(shots.x[i]);
+		s.projectileY.push_back(shots.y[i]);
+		s.projectileKind.push_back(shots.kind[i]);
+	}
+	s.gameTime = world->gameTime;
+	s.gold = world->gold;
+	s.tree = world->tree;
+	s.iron = world->iron;
+	s.ammoCore = world->ammoCore;
+	s.basePlaced = world->basePlaced;
+	s.baseHealth = world->baseHealth;
+	s.wave = world->wave;
+	s.targetPolicy = world->targetPolicy;
+	int previous = middle.exchange(back | freshBit, std::memory_order_acq_rel);
+	// Without freshBit the renderer has picked up the last publish, so it has the changes that one held.
+	if (!(previous & freshBit) && publishedEnd > journalFirst) {
+		journal.erase(journal.begin(), journal.begin() + (publishedEnd - journalFirst));
+		journalFirst = publishedEnd;
+	}
+	publishedEnd = journalFirst + journal.size();
+	back = previous & ~freshBit;
+}
+
+// Moves the world's mark changes to the journal. When some were dropped, or the renderer falls too far
+// behind, the journal starts over after a gap in the numbering, which tells the renderer to redraw.
+void SimThread::TakeMarkChanges() {
+	uint64_t end = journalFirst + journal.size();
+	if (world->marksDropped || journal.size() + world->markChanges.size() > (size_t)maxMarkChanges) {
+		journal.clear();
+		journalFirst = end + 1;
+		world->marksDropped = false;
+	}
+	journal.insert(journal.end(), world->markChanges.begin(), world->markChanges.end());
+	world->markChanges.clear();
+}
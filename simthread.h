@@ -0,0 +1,86 @@
+#pragma once
+#include "world.h"
+#include "save.h"
+#include "replay.h"
+#include <atomic>
+#include <thread>
+
+// What the render thread sees of the world: a copy the simulation thread takes after each step.
+struct WorldSnapshot {
+	int width = 0, height = 0;
+	// The world's own tiles; they only change on a new game or load, never while the simulation runs.
+	const Tile *tiles = nullptr;
+	// Per building: position and type, powered state and (cannons only) ammo.
+	std::vector<Building> buildings;
+	std::vector<unsigned char> powered;
+	std::vector<int> ammo;
+	std::vector<std::pair<int, int>> edges;
+	// Mark changes numbered from markFirst on, at least those since the renderer's last snapshot. A view
+	// that has followed fewer than markFirst of them has missed some and looks at `buildings` again.
+	std::vector<MarkChange> markChanges;
+	uint64_t markFirst = 0;
+	std::vector<float> enemyX, enemyY;
+	// Shots in flight, packed; the vectors keep their capacity between publishes.
+	std::vector<float> projectileX, projectileY;
+	std::vector<uint8_t> projectileKind;
+	uint64_t revision = 0;
+	float gameTime = 0.0f;
+	int gold = 0, tree = 0, iron = 0, ammoCore = 0;
+	bool basePlaced = false;
+	int baseHealth = 0, wave = 0;
+	TargetPolicy targetPolicy = TARGET_NEAREST;
+
+	int ResourceAt(int x, int y) const { return tiles[y * width + x] & tileResourceMask; }
+};
+
+const int commandQueueSize = 1024;
+
+// Lock-free ring of player commands with one producer (the render thread) and one consumer.
+struct CommandQueue {
+	bool Push(const Command &command);
+	bool Pop(Command &command);
+
+private:
+	Command items[commandQueueSize];
+	std::atomic<unsigned> head{0}, tail{0};
+};
+
+const float autosaveInterval = 10.0f;
+
+// Runs the world at the fixed step rate on its own thread. While it runs the world belongs to that thread:
+// the render thread only pushes commands and reads snapshots, which are triple-buffered so neither side
+// waits on the other. Autosaves are serialized on the simulation thread too.
+struct SimThread {
+	// `recording`, if not null, receives every command applied.
+	void Start(World &world, SaveWriter &saveWriter, Replay *recording);
+	// Joins the thread and applies commands still queued; the world belongs to the caller again.
+	void Stop();
+	void Push(const Command &command) { commands.Push(command); }
+	// The latest published snapshot. It stays untouched until the next Acquire().
+	const WorldSnapshot &Acquire();
+
+private:
+	World *world = nullptr;
+	SaveWriter *saveWriter = nullptr;
+	Replay *recording = nullptr;
+	std::thread worker;
+	std::atomic<bool> running{false};
+	CommandQueue commands;
+	WorldSnapshot buffers[3];
+	// `back` is written by the simulation, `front` read by the renderer; `middle` is swapped between them and
+	// carries freshBit while it holds a snapshot the renderer has not picked up yet.
+	static constexpr int freshBit = 4;
+	int back = 0, front = 2;
+	std::atomic<int> middle{1};
+	std::vector<unsigned char> saveBuffer;
+	float autosaveTimer = 0.0f;
+	// Mark changes from journalFirst on, kept until the renderer has picked up a snapshot holding them.
+	std::vector<MarkChange> journal;
+	uint64_t journalFirst = 0, publishedEnd = 0;
+
+	void Run();
+	void ApplyCommands();
+	void Autosave(float dt);
+	void Publish();
+	void TakeMarkChanges();
+};
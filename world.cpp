@@ -0,0 +1,1327 @@
+#include "world.h"
+#include "profiler.h"
+#include "bytes.h"
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <atomic>
+
+namespace {
+
+const int unpoweredHops = 1 << 30;
+const int dxs[4] = {-1, 1, 0, 0};
+const int dys[4] = {0, 0, -1, 1};
+
+int EconomyKindOf(BuildingType type) {
+	switch (type) {
+		case BUILD_GOLD_MINE: return ECON_GOLD_MINE;
+		case BUILD_SAWMILL: return ECON_SAWMILL;
+		case BUILD_IRON_MINE: return ECON_IRON_MINE;
+		case BUILD_FACTORY: return ECON_FACTORY;
+		case BUILD_CANNON: return ECON_CANNON;
+		case BUILD_ARCHER: return ECON_ARCHER;
+		default: return -1;
+	}
+}
+
+int ResourceFor(BuildingType type) {
+	switch (type) {
+		case BUILD_SAWMILL: return 1;
+		case BUILD_GOLD_MINE: return 2;
+		case BUILD_IRON_MINE: return 3;
+		default: return 0;
+	}
+}
+
+bool IsRelay(BuildingType type) { return type == BUILD_BASE || type == BUILD_TRANSPORTER; }
+
+// Transporters link to every building in range, all other buildings only link through transporters.
+bool CanLink(BuildingType a, BuildingType b) {
+	return a == BUILD_TRANSPORTER || b == BUILD_TRANSPORTER;
+}
+
+// Resources are generated in chunks of this many tiles square, on every core once the map is this large.
+const int resourceChunk = 64;
+const long long parallelGenerationArea = 512 * 512;
+
+// Murmur3's finalizer, to derive independent random streams from the seed.
+uint32_t Mix(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+// Saves are a versioned binary snapshot of the whole world. Values are stored in host byte order.
+const char saveMagic[4] = {'D', 'O', 'T', 'B'};
+const uint32_t saveVersion = 5;
+
+}
+
+void BuildingIndex::Reset(int mapWidth, int mapHeight) {
+	width = mapWidth;
+	height = mapHeight;
+	bucketCols = (width + bucketSize - 1) / bucketSize;
+	int bucketRows = (height + bucketSize - 1) / bucketSize;
+	buildings.clear();
+	powered.clear();
+	kindSlot.clear();
+	group.clear();
+	network.clear();
+	occupancy.assign(width * height, -1);
+	buckets.assign(bucketCols * bucketRows, {});
+}
+
+void BuildingIndex::Add(BuildingType type, int x, int y) {
+	int i = buildings.size();
+	buildings.push_back({type, x, y});
+	powered.push_back(0);
+	kindSlot.push_back(-1);
+	group.push_back(-1);
+	network.push_back(-1);
+	occupancy[y * width + x] = i;
+	buckets[BucketOf(x, y)].push_back(i);
+}
+
+void BuildingIndex::Remove(int x, int y) {
+	int i = occupancy[y * width + x];
+	if (i < 0) return;
+	std::vector<int> &bucket = buckets[BucketOf(x, y)];
+	bucket.erase(std::find(bucket.begin(), bucket.end(), i));
+	occupancy[y * width + x] = -1;
+	int last = buildings.size() - 1;
+	if (i != last) {
+		Building &moved = buildings[last];
+		occupancy[moved.y * width + moved.x] = i;
+		std::vector<int> &movedBucket = buckets[BucketOf(moved.x, moved.y)];
+		*std::find(movedBucket.begin(), movedBucket.end(), last) = i;
+		buildings[i] = moved;
+		powered[i] = powered[last];
+		kindSlot[i] = kindSlot[last];
+		group[i] = group[last];
+		network[i] = network[last];
+	}
+	buildings.pop_back();
+	powered.pop_back();
+	kindSlot.pop_back();
+	group.pop_back();
+	network.pop_back();
+}
+
+void PowerGrid::Reset(int mapWidth, int mapHeight) {
+	width = mapWidth;
+	nodeAt.assign(mapWidth * mapHeight, -1);
+	powered.assign(mapWidth * mapHeight, 0);
+	nodes.clear();
+	freeNodes.clear();
+	changed.clear();
+	relinked.clear();
+	edgesDirty = true;
+}
+
+const std::vector<std::pair<int, int>> &PowerGrid::Edges() {
+	if (edgesDirty) {
+		edges.clear();
+		for (int id = 0; id < (int)nodes.size(); id++) {
+			if (!powered[nodes[id].tile] || nodeAt[nodes[id].tile] != id) continue;
+			for (int n : nodes[id].links)
+				if (n > id && powered[nodes[n].tile])
+					edges.push_back({nodes[id].tile, nodes[n].tile});
+		}
+		edgesDirty = false;
+	}
+	return edges;
+}
+
+void PowerGrid::Add(BuildingType type, int x, int y, const BuildingIndex &index) {
+	PROFILE_SCOPE("power update");
+	int id;
+	if (!freeNodes.empty()) {
+		id = freeNodes.back();
+		freeNodes.pop_back();
+	} else {
+		id = nodes.size();
+		nodes.push_back({});
+	}
+	PowerNode &node = nodes[id];
+	node.tile = y * width + x;
+	node.type = type;
+	node.hops = unpoweredHops;
+	node.links.clear();
+	nodeAt[node.tile] = id;
+	relinked.push_back(node.tile);
+	auto byTile = [&](int a, int b) { return nodes[a].tile < nodes[b].tile; };
+	index.ForEachInRange(x, y, linkRange, [&](const Building &b) {
+		int other = nodeAt[b.y * width + b.x];
+		if (other < 0 || other == id || !CanLink(type, b.type)) return;
+		nodes[id].links.push_back(other);
+		std::vector<int> &back = nodes[other].links;
+		back.insert(std::upper_bound(back.begin(), back.end(), id, byTile), id);
+		relinked.push_back(nodes[other].tile);
+	});
+	std::sort(nodes[id].links.begin(), nodes[id].links.end(), byTile);
+	edgesDirty = true;
+	if (type == BUILD_BASE) {
+		Offer(id, 0);
+	} else if (type == BUILD_TRANSPORTER) {
+		for (int n : nodes[id].links)
+			if (IsRelay(nodes[n].type) && nodes[n].hops < maxHops)
+				Offer(id, nodes[n].hops + 1);
+	} else {
+		RefreshConsumer(id);
+	}
+}
+
+void PowerGrid::Remove(int x, int y) {
+	single.assign(1, y * width + x);
+	Remove(single);
+}
+
+void PowerGrid::Remove(const std::vector<int> &tiles) {
+	PROFILE_SCOPE("power update");
+	formers.clear();
+	seeds.clear();
+	for (int tile : tiles) {
+		int id = nodeAt[tile];
+		if (id < 0) continue;
+		PowerNode &node = nodes[id];
+		bool relay = IsRelay(node.type) && node.hops <= maxHops;
+		for (int n : node.links) {
+			std::vector<int> &back = nodes[n].links;
+			back.erase(std::find(back.begin(), back.end(), id));
+			formers.push_back(n);
+			relinked.push_back(nodes[n].tile);
+			if (relay) seeds.push_back({n, node.hops});
+		}
+		node.links.clear();
+		node.hops = unpoweredHops;
+		nodeAt[tile] = -1;
+		SetPowered(tile, false);
+		relinked.push_back(tile);
+		freeNodes.push_back(id);
+	}
+	edgesDirty = true;
+	// Everything whose hop count may have been supported by a removed node is reset and re-seeded from the
+	// untouched part of the network.
+	lost.clear();
+	stack.clear();
+	for (auto &seed : seeds)
+		if (nodes[seed.first].type == BUILD_TRANSPORTER && nodes[seed.first].hops == seed.second + 1) {
+			nodes[seed.first].hops = -nodes[seed.first].hops;
+			stack.push_back(seed.first);
+		}
+	while (!stack.empty()) {
+		int u = stack.back();
+		stack.pop_back();
+		lost.push_back(u);
+		for (int n : nodes[u].links)
+			if (nodes[n].type == BUILD_TRANSPORTER && nodes[n].hops == -nodes[u].hops + 1) {
+				nodes[n].hops = -nodes[n].hops;
+				stack.push_back(n);
+			}
+	}
+	for (int u : lost) {
+		nodes[u].hops = unpoweredHops;
+		SetPowered(nodes[u].tile, false);
+	}
+	for (int u : lost)
+		for (int n : nodes[u].links)
+			if (IsRelay(nodes[n].type) && nodes[n].hops < maxHops)
+				Offer(u, nodes[n].hops + 1);
+	Relax();
+	for (int n : formers)
+		if (nodeAt[nodes[n].tile] == n && !IsRelay(nodes[n].type))
+			RefreshConsumer(n);
+	for (int u : lost)
+		if (!powered[nodes[u].tile])
+			for (int n : nodes[u].links)
+				if (!IsRelay(nodes[n].type))
+					RefreshConsumer(n);
+}
+
+void PowerGrid::SetPowered(int tile, bool on) {
+	if (powered[tile] == on) return;
+	powered[tile] = on;
+	changed.push_back(tile);
+}
+
+void PowerGrid::Offer(int id, int hops) {
+	if (hops >= nodes[id].hops) return;
+	nodes[id].hops = hops;
+	buckets[hops].push_back(id);
+}
+
+void PowerGrid::RefreshConsumer(int id) {
+	bool on = false;
+	for (int n : nodes[id].links)
+		if (powered[nodes[n].tile]) {
+			on = true;
+			break;
+		}
+	SetPowered(nodes[id].tile, on);
+}
+
+// Bucketed BFS over the offered hop counts; a node is expanded only at its final (smallest) count.
+void PowerGrid::Relax() {
+	for (int h = 0; h <= maxHops; h++) {
+		for (size_t i = 0; i < buckets[h].size(); i++) {
+			int u = buckets[h][i];
+			if (nodes[u].hops != h) continue;
+			SetPowered(nodes[u].tile, true);
+			for (int n : nodes[u].links) {
+				if (nodes[n].type == BUILD_TRANSPORTER) {
+					if (h < maxHops) Offer(n, h + 1);
+				} else if (!IsRelay(nodes[n].type)) {
+					SetPowered(nodes[n].tile, true);
+				}
+			}
+		}
+		buckets[h].clear();
+	}
+}
+
+World::World(int mapWidth, int mapHeight) {
+	Resize(mapWidth, mapHeight);
+}
+
+void World::Resize(int mapWidth, int mapHeight) {
+	width = mapWidth;
+	height = mapHeight;
+	tiles.assign(width * height, 0);
+	Clear();
+}
+
+void World::Clear() {
+	markChanges.clear();
+	marksDropped = true;
+	index.Reset(width, height);
+	powerGrid.Reset(width, height);
+	for (auto &list : economy) list = EconomyList();
+	gameTime = 8.0f;
+	timeOfDay = 8.0f / 24.0f;
+	timer = 0.0f;
+	timeSpeed = 1.0f;
+	accumulator = 0.0f;
+	ticks = 0;
+	revision++;
+	gold = 0;
+	tree = 0;
+	iron = 0;
+	ammoCore = 0;
+	stocks.clear();
+	networks.clear();
+	groups.clear();
+	freeGroups.clear();
+	freeNetworks.clear();
+	logisticsChanged.clear();
+	history.clear();
+	historyPos = 0;
+	basePlaced = false;
+	flowField.Reset(width, height);
+	baseX = baseY = -1;
+	baseHealth = baseMaxHealth;
+	enemies.Clear();
+	projectiles.Clear();
+	wave = 0;
+	nightActive = false;
+	spawnBudget = 0.0f;
+	waveRandom = 1;
+	targetPolicy = TARGET_NEAREST;
+}
+
+void World::NewGame() {
+	NewGame(std::random_device{}());
+}
+
+void World::NewGame(uint32_t newSeed) {
+	seed = newSeed;
+	std::fill(tiles.begin(), tiles.end(), 0);
+	Clear();
+	waveRandom = seed | 1;
+	// Resource counts are tuned for the default 40x40 map and scale with the map area.
+	long long area = (long long)width * height, defaultArea = defaultMapWidth * defaultMapHeight;
+	const long long counts[resourceKinds] = {
+		std::max(1LL, 50 * area / defaultArea), std::max(1LL, 20 * area / defaultArea), std::max(1LL, 20 * area / defaultArea)
+	};
+	GenerateIsolatedResources(counts);
+	saveDirty = true;
+}
+
+void World::Step(float dt) {
+	accumulator += dt;
+	int steps = 0;
+	while (accumulator >= fixedStep && steps < maxStepsPerUpdate) {
+		Tick(fixedStep);
+		accumulator -= fixedStep;
+		steps++;
+	}
+	// After a long stall, drop the whole steps left over instead of spiralling, keeping the fraction of one.
+	if (accumulator >= fixedStep) accumulator = std::fmod(accumulator, fixedStep);
+}
+
+void World::Tick(float dt) {
+	ticks++;
+	Advance(dt * timeSpeed);
+}
+
+void World::Advance(float hours) {
+	while (hours > 0.0f) {
+		float step = std::min(hours, std::max(QuietTime(), maxGameStep));
+		GameStep(step);
+		hours -= step;
+	}
+}
+
+float World::CatchUp(double awaySeconds) {
+	float hours = (float)std::min(awaySeconds * timeSpeed, (double)maxCatchUpHours);
+	if (hours <= 0.0f) return 0.0f;
+	Advance(hours);
+	return hours;
+}
+
+void World::GameStep(float dt) {
+	timer += dt;
+	gameTime += dt;
+	while (gameTime >= 24.0f) gameTime -= 24.0f;
+	timeOfDay += dt * 0.05f;
+	while (timeOfDay > 1.0f) timeOfDay -= 1.0f;
+	EnemyTick(dt);
+	if (timer >= 1.0f) {
+		int due = (int)timer;
+		EconomyTick(due);
+		timer -= due;
+		saveDirty = true;
+	}
+}
+
+// How long nothing but the economy will happen: no units or shots are out and no wave starts or ends.
+float World::QuietTime() const {
+	if (enemies.Count() > 0 || projectiles.Live() > 0) return 0.0f;
+	if (!basePlaced) return std::numeric_limits<float>::infinity();
+	bool night = gameTime >= nightStart || gameTime < nightEnd;
+	// A new night still bumps the wave count after the base has fallen, so stop at dusk either way.
+	if (!night) return nightStart - gameTime;
+	if (baseHealth > 0 || !nightActive) return 0.0f;
+	return gameTime >= nightStart ? 24.0f - gameTime + nightEnd : nightEnd - gameTime;
+}
+
+// Bases and transporters linked to each other form networks, and bases whose networks have joined pool their
+// stock in the one placed first. Powered mines send what they produce toward the bases as a maximum flow,
+// every link carrying at most linkCapacity; what a mine cannot get through is lost. A mine linked to several
+// networks makes them one group, solved as one flow; groups are disconnected, so each is solved on its own.
+// Only groups holding a changed building, or one linked to it, are taken apart and solved again: the rest
+// keep their networks and flows. Groups are laid out in tile order, so a group solves the same however it
+// came about, and so does a loaded world.
+void World::SolveLogistics() {
+	PROFILE_SCOPE("logistics");
+	consumerQueued.resize(index.buildings.size());
+	logisticsPool.clear();
+	logisticsConsumers.clear();
+	newGroups.clear();
+	deadNetworks.clear();
+	auto visit = [&](int tile) {
+		int i = index.occupancy[tile];
+		if (i < 0) return;
+		if (index.group[i] >= 0) DissolveGroup(index.group[i]);
+		logisticsPool.push_back(tile);
+		QueueConsumer(tile);
+	};
+	std::sort(logisticsChanged.begin(), logisticsChanged.end());
+	logisticsChanged.erase(std::unique(logisticsChanged.begin(), logisticsChanged.end()), logisticsChanged.end());
+	for (int tile : logisticsChanged) {
+		visit(tile);
+		powerGrid.ForEachLink(tile, visit);
+	}
+	logisticsChanged.clear();
+
+	// Regroups what was taken apart. A group reached that was not, which the changes should rule out, is
+	// taken apart and joined too.
+	for (size_t p = 0; p < logisticsPool.size(); p++) {
+		int first = index.occupancy[logisticsPool[p]];
+		if (first < 0 || index.group[first] >= 0 || !IsLogisticsNode(first)) continue;
+		int g;
+		if (!freeGroups.empty()) {
+			g = freeGroups.back();
+			freeGroups.pop_back();
+		} else {
+			g = groups.size();
+			groups.emplace_back();
+		}
+		newGroups.push_back(g);
+		index.group[first] = g;
+		groups[g].tiles.assign(1, logisticsPool[p]);
+		logisticsStack.assign(1, logisticsPool[p]);
+		while (!logisticsStack.empty()) {
+			int tile = logisticsStack.back();
+			logisticsStack.pop_back();
+			powerGrid.ForEachLink(tile, [&](int other) {
+				int j = index.occupancy[other];
+				if (!IsLogisticsNode(j)) return;
+				if (index.group[j] >= 0 && index.group[j] != g) DissolveGroup(index.group[j]);
+				if (index.group[j] >= 0) return;
+				index.group[j] = g;
+				groups[g].tiles.push_back(other);
+				logisticsStack.push_back(other);
+			});
+		}
+	}
+	for (int g : newGroups)
+		if (!groups[g].tiles.empty()) SolveGroup(g);
+	// Networks that were not taken apart have pooled already, their other bases hold nothing.
+	for (size_t s = 0; s < stocks.size(); s++) {
+		Network &network = networks[index.network[index.occupancy[stocks[s].tile]]];
+		if (network.stock < 0) {
+			network.stock = s;
+			continue;
+		}
+		if (network.stock == (int)s) continue;
+		BaseStock &into = stocks[network.stock];
+		into.gold += stocks[s].gold;
+		into.tree += stocks[s].tree;
+		into.iron += stocks[s].iron;
+		into.ammoCore += stocks[s].ammoCore;
+		stocks[s] = {stocks[s].tile, 0, 0, 0, 0};
+	}
+	// Every consumer draws from the network of the first base or transporter it links to. That changes only
+	// for those next to a change, queued above, and those whose network was taken apart.
+	if (!deadNetworks.empty())
+		for (const EconomyList &list : economy)
+			for (size_t slot = 0; slot < list.tile.size(); slot++)
+				if (list.network[slot] >= 0 && networks[list.network[slot]].stock < 0) QueueConsumer(list.tile[slot]);
+	for (int tile : logisticsConsumers) {
+		int i = index.occupancy[tile];
+		consumerQueued[i] = 0;
+		int kind = EconomyKindOf(index.buildings[i].type), slot = index.kindSlot[i];
+		if (kind < 0) continue;
+		EconomyList &list = economy[kind];
+		int &network = list.network[slot];
+		if (kind == ECON_FACTORY && network >= 0 && networks[network].stock >= 0) networks[network].factories--;
+		network = -1;
+		if (!list.powered[slot]) continue;
+		powerGrid.ForEachLink(tile, [&](int other) {
+			if (network < 0) network = index.network[index.occupancy[other]];
+		});
+		if (kind == ECON_FACTORY && network >= 0) networks[network].factories++;
+	}
+	freeNetworks.insert(freeNetworks.end(), deadNetworks.begin(), deadNetworks.end());
+}
+
+// Powered bases and transporters, and powered mines next to their resource.
+bool World::IsLogisticsNode(int i) const {
+	if (!index.powered[i]) return false;
+	BuildingType type = index.buildings[i].type;
+	if (IsRelay(type)) return true;
+	int kind = EconomyKindOf(type);
+	return kind >= 0 && kind <= ECON_IRON_MINE && economy[kind].nearResource[index.kindSlot[i]];
+}
+
+// Unlabels the group's buildings for SolveLogistics() to regroup. Its networks are freed once the solve is
+// done, so that consumers still pointing at them can tell.
+void World::DissolveGroup(int g) {
+	LogisticsGroup &group = groups[g];
+	for (int tile : group.tiles) {
+		int i = index.occupancy[tile];
+		if (i < 0 || index.group[i] != g) continue;
+		index.group[i] = index.network[i] = -1;
+		logisticsPool.push_back(tile);
+	}
+	for (int id : group.networks) {
+		networks[id].stock = -1;
+		deadNetworks.push_back(id);
+	}
+	group.tiles.clear();
+	group.networks.clear();
+	freeGroups.push_back(g);
+}
+
+void World::QueueConsumer(int tile) {
+	int i = index.occupancy[tile];
+	if (i < 0 || index.kindSlot[i] < 0 || consumerQueued[i]) return;
+	consumerQueued[i] = 1;
+	logisticsConsumers.push_back(tile);
+}
+
+int World::NewNetwork() {
+	int id;
+	if (!freeNetworks.empty()) {
+		id = freeNetworks.back();
+		freeNetworks.pop_back();
+	} else {
+		id = networks.size();
+		networks.emplace_back();
+	}
+	networks[id] = {-1, 0, 0, 0, 0};
+	return id;
+}
+
+// Node k is the group's k-th tile, plus one source feeding the mines and one sink behind the bases. Links, and
+// so arcs, come in tile order too, which fixes the flow Dinic's algorithm finds. The links between bases and
+// transporters also split the group into its networks.
+void World::SolveGroup(int g) {
+	LogisticsGroup &group = groups[g];
+	std::vector<int> &tiles = group.tiles;
+	std::sort(tiles.begin(), tiles.end());
+	int count = tiles.size(), source = count, sink = count + 1;
+	nodeOf.resize(index.buildings.size());
+	for (int u = 0; u < count; u++) nodeOf[index.occupancy[tiles[u]]] = u;
+	auto root = [&](int u) {
+		while (joinedTo[u] != u) u = joinedTo[u] = joinedTo[joinedTo[u]];
+		return u;
+	};
+	joinedTo.resize(count);
+	for (int u = 0; u < count; u++) joinedTo[u] = u;
+	group.graph.Reset(count + 2);
+	group.mineArcs.clear();
+	const int rates[ECON_KINDS] = {goldMineRate, sawmillRate, ironMineRate};
+	for (int pass = 0; pass < 2; pass++)
+		for (int u = 0; u < count; u++) {
+			const Building &b = index.buildings[index.occupancy[tiles[u]]];
+			bool relay = IsRelay(b.type);
+			if (relay != (pass == 0)) continue;
+			if (b.type == BUILD_BASE) group.graph.AddArc(u, sink, std::numeric_limits<int>::max());
+			if (!relay) group.graph.AddArc(source, u, rates[EconomyKindOf(b.type)]);
+			powerGrid.ForEachLink(tiles[u], [&](int other) {
+				int j = index.occupancy[other];
+				if (index.group[j] != g) return;
+				if (!relay) {
+					group.mineArcs.push_back(group.graph.AddArc(u, nodeOf[j], linkCapacity));
+				} else if (IsRelay(index.buildings[j].type) && other > tiles[u]) {
+					group.graph.AddArc(u, nodeOf[j], linkCapacity, linkCapacity);
+					joinedTo[root(nodeOf[j])] = root(u);
+				}
+			});
+		}
+	rootNetwork.assign(count, -1);
+	for (int u = 0; u < count; u++) {
+		int i = index.occupancy[tiles[u]];
+		if (!IsRelay(index.buildings[i].type)) continue;
+		int &id = rootNetwork[root(u)];
+		if (id < 0) {
+			id = NewNetwork();
+			group.networks.push_back(id);
+		}
+		index.network[i] = id;
+	}
+	group.graph.MaxFlow(source, sink);
+	for (int arc : group.mineArcs) {
+		Network &network = networks[index.network[index.occupancy[tiles[group.graph.To(arc)]]]];
+		int sent = group.graph.Flow(arc);
+		switch (index.buildings[index.occupancy[tiles[group.graph.From(arc)]]].type) {
+			case BUILD_GOLD_MINE: network.gold += sent; break;
+			case BUILD_SAWMILL: network.tree += sent; break;
+			default: network.iron += sent; break;
+		}
+	}
+}
+
+void World::SumStocks() {
+	gold = tree = iron = ammoCore = 0;
+	for (const BaseStock &stock : stocks) {
+		gold += stock.gold;
+		tree += stock.tree;
+		iron += stock.iron;
+		ammoCore += stock.ammoCore;
+	}
+}
+
+// Runs `count` economy ticks at once. Nothing else changes between them, so each network's stock follows a
+// closed form: iron grows by what gets delivered and factories take what they can, which leaves max(iron +
+// count * (delivered - factories), 0) when factories outpace the mines. Cannons never spend ammo here, so
+// topping them up from the whole batch fills them in the same order as tick by tick.
+void World::EconomyTick(int count) {
+	if (!logisticsChanged.empty()) SolveLogistics();
+	long long n = count;
+	for (const Network &network : networks) {
+		if (network.stock < 0) continue;
+		BaseStock &stock = stocks[network.stock];
+		stock.gold += n * network.gold;
+		stock.tree += n * network.tree;
+		long long mined = n * network.iron;
+		long long ironLeft = std::max(stock.iron + mined - n * network.factories, 0LL);
+		stock.ammoCore += stock.iron + mined - ironLeft;
+		stock.iron = ironLeft;
+	}
+	EconomyList &cannons = economy[ECON_CANNON];
+	for (size_t i = 0; i < cannons.tile.size(); i++) {
+		if (!cannons.powered[i] || cannons.network[i] < 0) continue;
+		int &pool = stocks[networks[cannons.network[i]].stock].ammoCore;
+		int take = std::min(std::max(cannonCapacity - cannons.ammo[i], 0), pool);
+		cannons.ammo[i] += take;
+		pool -= take;
+	}
+	SumStocks();
+}
+
+// Each night's wave is larger and tougher than the last; its units spawn evenly over the night.
+void World::EnemyTick(float dt) {
+	if (!basePlaced) return;
+	bool night = gameTime >= nightStart || gameTime < nightEnd;
+	if (night && !nightActive) wave++;
+	nightActive = night;
+	// Once the base has fallen no new waves come.
+	if (night && baseHealth > 0) {
+		float nightLength = 24.0f - nightStart + nightEnd;
+		spawnBudget += (30 * wave + 5 * wave * wave) / nightLength * dt;
+		for (; spawnBudget >= 1.0f; spawnBudget -= 1.0f) SpawnEnemy();
+	}
+	if (enemies.Count() == 0 && projectiles.Live() == 0) return;
+	PROFILE_SCOPE("enemies");
+	// Every unit heads for the centre of the next tile on its flow field path.
+	flowField.Update();
+	size_t n = enemies.Count();
+	enemies.goalX.resize(n);
+	enemies.goalY.resize(n);
+	for (size_t i = 0; i < n; i++) {
+		int tx = std::clamp((int)enemies.x[i], 0, width - 1), ty = std::clamp((int)enemies.y[i], 0, height - 1);
+		int next = flowField.Next(PosToIndex(tx, ty));
+		enemies.goalX[i] = next % width + 0.5f;
+		enemies.goalY[i] = next / width + 0.5f;
+	}
+	enemies.Move(dt);
+	enemyGrid.Build(enemies, width, height);
+	projectiles.Advance(dt, [&](ProjectileKind kind, float x, float y) { ProjectileImpact(kind, x, y); });
+	FireTowers(ECON_ARCHER, archerStats, dt);
+	FireTowers(ECON_CANNON, cannonStats, dt);
+	float targetX = baseX + 0.5f, targetY = baseY + 0.5f;
+	int hits = (int)enemies.Cull(targetX, targetY, 0.5f);
+	if (hits > 0) {
+		baseHealth = std::max(baseHealth - hits, 0);
+		saveDirty = true;
+	}
+	PROFILE_COUNTER("enemies", enemies.Count());
+	PROFILE_COUNTER("projectiles live", projectiles.Live());
+	PROFILE_COUNTER("projectiles peak", projectiles.Peak());
+}
+
+void World::FireTowers(EconomyKind kind, const TowerStats &stats, float dt) {
+	EconomyList &towers = economy[kind];
+	for (size_t t = 0; t < towers.tile.size(); t++) {
+		if (!towers.powered[t]) continue;
+		float &cooldown = towers.cooldown[t];
+		cooldown -= dt;
+		float x = towers.tile[t] % width + 0.5f, y = towers.tile[t] / width + 0.5f;
+		while (cooldown <= 0.0f) {
+			if (kind == ECON_CANNON && towers.ammo[t] == 0) break;
+			int target = PickTarget(x, y, stats.range);
+			if (target < 0) break;
+			// Lead the target by where its current heading takes it while the shot is in the air.
+			float aimX = enemies.x[target], aimY = enemies.y[target];
+			float dx = enemies.goalX[target] - aimX, dy = enemies.goalY[target] - aimY;
+			float toGoal = std::sqrt(dx * dx + dy * dy);
+			float flight = std::sqrt((aimX - x) * (aimX - x) + (aimY - y) * (aimY - y)) / stats.projectileSpeed;
+			float lead = std::min(enemies.speed[target] * flight, toGoal);
+			if (toGoal > 0.0f) aimX += dx / toGoal * lead, aimY += dy / toGoal * lead;
+			ProjectileKind shot = kind == ECON_CANNON ? PROJECTILE_CANNONBALL : PROJECTILE_ARROW;
+			// With the pool full the shot is lost, like any miss.
+			projectiles.Spawn(shot, x, y, aimX, aimY, stats.projectileSpeed);
+			if (kind == ECON_CANNON) towers.ammo[t]--;
+			cooldown += stats.interval;
+		}
+		// A tower with nothing to shoot at stays ready instead of banking shots.
+		cooldown = std::max(cooldown, 0.0f);
+	}
+}
+
+void World::ProjectileImpact(ProjectileKind kind, float x, float y) {
+	const TowerStats &stats = kind == PROJECTILE_CANNONBALL ? cannonStats : archerStats;
+	int hit = -1;
+	float hitDistance = 0.0f;
+	enemyGrid.ForEachInRange(enemies, x, y, projectileHitRadius, [&](int i) {
+		if (enemies.health[i] <= 0.0f) return;
+		float dx = enemies.x[i] - x, dy = enemies.y[i] - y;
+		float distance = dx * dx + dy * dy;
+		if (hit < 0 || distance < hitDistance || (distance == hitDistance && i < hit)) {
+			hit = i;
+			hitDistance = distance;
+		}
+	});
+	if (hit >= 0) enemies.health[hit] -= stats.damage;
+	if (stats.splash > 0.0f)
+		enemyGrid.ForEachInRange(enemies, x, y, stats.splash, [&](int i) {
+			if (i != hit) enemies.health[i] -= stats.splashDamage;
+		});
+}
+
+int World::PickTarget(float x, float y, float range) const {
+	int best = -1;
+	float bestScore = 0.0f;
+	enemyGrid.ForEachInRange(enemies, x, y, range, [&](int i) {
+		if (enemies.health[i] <= 0.0f) return;
+		float score;
+		if (targetPolicy == TARGET_LOWEST_HEALTH) {
+			score = enemies.health[i];
+		} else if (targetPolicy == TARGET_FIRST) {
+			int tx = std::clamp((int)enemies.x[i], 0, width - 1), ty = std::clamp((int)enemies.y[i], 0, height - 1);
+			score = flowField.Distance(PosToIndex(tx, ty));
+		} else {
+			float dx = enemies.x[i] - x, dy = enemies.y[i] - y;
+			score = dx * dx + dy * dy;
+		}
+		// Ties go to the lower index so the choice does not depend on grid order.
+		if (best < 0 || score < bestScore || (score == bestScore && i < best)) {
+			best = i;
+			bestScore = score;
+		}
+	});
+	return best;
+}
+
+void World::SpawnEnemy() {
+	float along = WaveRandom() * 2.0f * (width + height);
+	float x, y;
+	if (along < width) x = along, y = 0.0f;
+	else if ((along -= width) < height) x = width, y = along;
+	else if ((along -= height) < width) x = along, y = height;
+	else x = 0.0f, y = along - width;
+	enemies.Spawn(x, y, 10.0f + 2.0f * wave, 1.5f, 10.0f);
+}
+
+int World::PathCost(int x, int y) const {
+	if (BuildingAt(x, y)) return buildingPathCost;
+	return ResourceAt(x, y) ? resourcePathCost : openPathCost;
+}
+
+// xorshift32, kept apart from the map generator so its state is small enough to go into saves.
+float World::WaveRandom() {
+	waveRandom ^= waveRandom << 13;
+	waveRandom ^= waveRandom >> 17;
+	waveRandom ^= waveRandom << 5;
+	return (waveRandom >> 8) * (1.0f / (1 << 24));
+}
+
+int World::CannonAmmo(int x, int y) const {
+	const Building *b = BuildingAt(x, y);
+	if (!b || b->type != BUILD_CANNON) return 0;
+	return economy[ECON_CANNON].ammo[index.kindSlot[index.occupancy[PosToIndex(x, y)]]];
+}
+
+bool World::IsNextTo(int x, int y, int resourceId) const {
+	for (int d = 0; d < 4; d++) {
+		int nx = x + dxs[d];
+		int ny = y + dys[d];
+		if (IsInsideMap(nx, ny) && ResourceAt(nx, ny) == resourceId)
+			return true;
+	}
+	return false;
+}
+
+bool World::CanPlace(BuildingType type, int x, int y) const {
+	if (type <= BUILD_NONE || type > BUILD_CANNON) return false;
+	if (!IsInsideMap(x, y) || BuildingAt(x, y) || ResourceAt(x, y) != 0) return false;
+	if (type == BUILD_BASE) return true;
+	if (!basePlaced) return false;
+	if (type == BUILD_GOLD_MINE) return IsNextTo(x, y, 2);
+	if (type == BUILD_SAWMILL) return IsNextTo(x, y, 1);
+	if (type == BUILD_IRON_MINE) return IsNextTo(x, y, 3);
+	return true;
+}
+
+bool World::Place(BuildingType type, int x, int y) {
+	if (!CanPlace(type, x, y)) return false;
+	AddBuilding(type, x, y);
+	return true;
+}
+
+bool World::Remove(int x, int y) {
+	if (!IsInsideMap(x, y)) return false;
+	const Building *b = BuildingAt(x, y);
+	if (!b || b->type == BUILD_BASE) return false;
+	RemoveBuilding(x, y);
+	return true;
+}
+
+// Clamps the rectangle to the map with x0 <= x1 and y0 <= y1, and checks that it is not too large.
+bool World::AreaTiles(int &x0, int &y0, int &x1, int &y1) const {
+	if (x0 > x1) std::swap(x0, x1);
+	if (y0 > y1) std::swap(y0, y1);
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, width - 1);
+	y1 = std::min(y1, height - 1);
+	return x0 <= x1 && y0 <= y1 && (long long)(x1 - x0 + 1) * (y1 - y0 + 1) <= maxAreaTiles;
+}
+
+int World::PlaceArea(BuildingType type, int x0, int y0, int x1, int y1) {
+	if (type == BUILD_BASE || !AreaTiles(x0, y0, x1, y1)) return 0;
+	std::vector<Building> wanted, placed;
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++) wanted.push_back({type, x, y});
+	PlaceAll(wanted, placed);
+	int count = placed.size();
+	RecordAction(true, std::move(placed));
+	return count;
+}
+
+int World::RemoveArea(int x0, int y0, int x1, int y1) {
+	if (!AreaTiles(x0, y0, x1, y1)) return 0;
+	std::vector<Building> wanted, removed;
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			if (const Building *b = BuildingAt(x, y)) wanted.push_back(*b);
+	RemoveAll(wanted, removed);
+	int count = removed.size();
+	RecordAction(false, std::move(removed));
+	return count;
+}
+
+void World::PlaceAll(const std::vector<Building> &wanted, std::vector<Building> &done) {
+	done.clear();
+	for (const Building &b : wanted) {
+		if (b.type == BUILD_BASE || !CanPlace(b.type, b.x, b.y)) continue;
+		InsertBuilding(b.type, b.x, b.y);
+		done.push_back(b);
+	}
+	if (!done.empty()) FinishBuildChanges();
+}
+
+// Only takes down a building that is still the one wanted, never a base. The power network drops them all
+// before it re-seeds what they supported.
+void World::RemoveAll(const std::vector<Building> &wanted, std::vector<Building> &done) {
+	done.clear();
+	std::vector<int> tiles;
+	for (const Building &b : wanted) {
+		const Building *standing = IsInsideMap(b.x, b.y) ? BuildingAt(b.x, b.y) : nullptr;
+		if (!standing || standing->type != b.type || b.type == BUILD_BASE) continue;
+		tiles.push_back(PosToIndex(b.x, b.y));
+		done.push_back(b);
+	}
+	if (done.empty()) return;
+	powerGrid.Remove(tiles);
+	for (const Building &b : done) EraseBuilding(b.x, b.y);
+	FinishBuildChanges();
+}
+
+// Starts a new branch of history: whatever was undone can no longer be redone.
+void World::RecordAction(bool placed, std::vector<Building> buildings) {
+	if (buildings.empty()) return;
+	history.resize(historyPos);
+	history.push_back({placed, std::move(buildings)});
+	if (history.size() > (size_t)maxUndoActions) history.erase(history.begin());
+	historyPos = history.size();
+}
+
+// Undoing and redoing only reverse what still can be; an action keeps just the buildings that took part,
+// so it stays its own inverse.
+bool World::Undo() {
+	if (historyPos == 0) return false;
+	BuildAction &action = history[--historyPos];
+	std::vector<Building> done;
+	if (action.placed) RemoveAll(action.buildings, done);
+	else PlaceAll(action.buildings, done);
+	action.buildings = std::move(done);
+	return true;
+}
+
+bool World::Redo() {
+	if (historyPos == history.size()) return false;
+	BuildAction &action = history[historyPos++];
+	std::vector<Building> done;
+	if (action.placed) PlaceAll(action.buildings, done);
+	else RemoveAll(action.buildings, done);
+	action.buildings = std::move(done);
+	return true;
+}
+
+bool World::Apply(const Command &command) {
+	switch (command.kind) {
+		case CMD_PLACE:
+			if (!Place(command.type, command.x, command.y)) return false;
+			// Bases cannot be taken down, so placing one is not an action to undo.
+			if (command.type != BUILD_BASE) RecordAction(true, {{command.type, command.x, command.y}});
+			return true;
+		case CMD_REMOVE: {
+			const Building *b = IsInsideMap(command.x, command.y) ? BuildingAt(command.x, command.y) : nullptr;
+			Building removed = b ? *b : Building{BUILD_NONE, command.x, command.y};
+			if (!Remove(command.x, command.y)) return false;
+			RecordAction(false, {removed});
+			return true;
+		}
+		case CMD_PLACE_AREA: return PlaceArea(command.type, command.x, command.y, command.toX, command.toY) > 0;
+		case CMD_REMOVE_AREA: return RemoveArea(command.x, command.y, command.toX, command.toY) > 0;
+		case CMD_UNDO: return Undo();
+		case CMD_REDO: return Redo();
+		case CMD_SPEED:
+			if (!(command.speed >= 0.0f && command.speed <= maxTimeSpeed)) return false;
+			timeSpeed = command.speed;
+			return true;
+		case CMD_TARGET_POLICY:
+			if (command.x < 0 || command.x >= TARGET_POLICIES) return false;
+			targetPolicy = (TargetPolicy)command.x;
+			return true;
+		case COMMAND_KINDS: break;
+	}
+	return false;
+}
+
+void World::AddBuilding(BuildingType type, int x, int y) {
+	InsertBuilding(type, x, y);
+	FinishBuildChanges();
+}
+
+void World::RemoveBuilding(int x, int y) {
+	powerGrid.Remove(x, y);
+	EraseBuilding(x, y);
+	FinishBuildChanges();
+}
+
+void World::FinishBuildChanges() {
+	powerGrid.Update();
+	SyncPower();
+	revision++;
+	saveDirty = true;
+}
+
+void World::InsertBuilding(BuildingType type, int x, int y) {
+	index.Add(type, x, y);
+	LogMark(PosToIndex(x, y), MARK_NONE, type == BUILD_BASE ? MARK_BASE : MARK_UNPOWERED);
+	int kind = EconomyKindOf(type);
+	if (kind >= 0) {
+		EconomyList &list = economy[kind];
+		int resource = ResourceFor(type);
+		index.kindSlot.back() = list.tile.size();
+		list.tile.push_back(PosToIndex(x, y));
+		list.nearResource.push_back(resource == 0 || IsNextTo(x, y, resource));
+		list.powered.push_back(0);
+		list.network.push_back(-1);
+		list.ammo.push_back(0);
+		list.cooldown.push_back(0.0f);
+	}
+	powerGrid.Add(type, x, y, index);
+	if (type == BUILD_BASE) stocks.push_back({PosToIndex(x, y), 0, 0, 0, 0});
+	if (type == BUILD_BASE && !basePlaced) {
+		basePlaced = true;
+		baseX = x;
+		baseY = y;
+		for (int ty = 0; ty < height; ty++)
+			for (int tx = 0; tx < width; tx++) flowField.SetCost(PosToIndex(tx, ty), PathCost(tx, ty));
+		flowField.Build(PosToIndex(x, y));
+	} else {
+		flowField.SetCost(PosToIndex(x, y), buildingPathCost);
+	}
+}
+
+void World::EraseBuilding(int x, int y) {
+	int tile = PosToIndex(x, y);
+	int i = index.occupancy[tile];
+	LogMark(tile, index.buildings[i].type == BUILD_BASE ? MARK_BASE : index.powered[i] ? MARK_POWERED : MARK_UNPOWERED, MARK_NONE);
+	int kind = EconomyKindOf(index.buildings[i].type), slot = index.kindSlot[i];
+	index.Remove(x, y);
+	if (kind >= 0) {
+		EconomyList &list = economy[kind];
+		int last = list.tile.size() - 1;
+		if (slot != last) index.kindSlot[index.occupancy[list.tile[last]]] = slot;
+		list.tile[slot] = list.tile[last];
+		list.nearResource[slot] = list.nearResource[last];
+		list.powered[slot] = list.powered[last];
+		list.network[slot] = list.network[last];
+		list.ammo[slot] = list.ammo[last];
+		list.cooldown[slot] = list.cooldown[last];
+		list.tile.pop_back();
+		list.nearResource.pop_back();
+		list.powered.pop_back();
+		list.network.pop_back();
+		list.ammo.pop_back();
+		list.cooldown.pop_back();
+	}
+	flowField.SetCost(tile, PathCost(x, y));
+}
+
+void World::LogMark(int tile, TileMark from, TileMark to) {
+	if (markChanges.size() == (size_t)maxMarkChanges) {
+		markChanges.clear();
+		marksDropped = true;
+	}
+	markChanges.push_back({tile, from, to});
+}
+
+// Applies the power flips of the last network update to the powered flags of buildings and economy lists.
+void World::SyncPower() {
+	for (int tile : powerGrid.Changed()) {
+		int i = index.occupancy[tile];
+		if (i < 0) continue;
+		bool on = powerGrid.IsPowered(tile);
+		if (on != (index.powered[i] != 0) && index.buildings[i].type != BUILD_BASE)
+			LogMark(tile, on ? MARK_UNPOWERED : MARK_POWERED, on ? MARK_POWERED : MARK_UNPOWERED);
+		index.powered[i] = on;
+		int slot = index.kindSlot[i];
+		if (slot < 0) continue;
+		economy[EconomyKindOf(index.buildings[i].type)].powered[slot] = on;
+	}
+	logisticsChanged.insert(logisticsChanged.end(), powerGrid.Changed().begin(), powerGrid.Changed().end());
+	logisticsChanged.insert(logisticsChanged.end(), powerGrid.Relinked().begin(), powerGrid.Relinked().end());
+	powerGrid.ClearChanged();
+}
+
+bool World::IsFreeAround(int x, int y) const {
+	for (int dy = -1; dy <= 1; dy++) {
+		for (int dx = -1; dx <= 1; dx++) {
+			int nx = x + dx;
+			int ny = y + dy;
+			if (IsInsideMap(nx, ny) && ResourceAt(nx, ny) != 0) return false;
+		}
+	}
+	return true;
+}
+
+// Poisson-disk sampling with a minimum spacing of two tiles, using the tile grid itself as the background
+// grid: a candidate is accepted if its 3x3 window is empty. The map is cut into chunks that each get their
+// share of every count, in proportion to their area, and their own random stream derived from the seed.
+// Chunks are filled in four passes of alternating rows and columns. Within a pass no two chunks touch, so
+// they run on all cores and the result does not depend on how many there are. Each chunk throws random darts
+// and then, if they fall short, scans its tiles. Whatever a crowded chunk could not place is made up by a
+// final scan over the whole map. Every count is met as long as the map has room for it.
+void World::GenerateIsolatedResources(const long long (&counts)[resourceKinds]) {
+	int chunkCols = (width + resourceChunk - 1) / resourceChunk, chunkRows = (height + resourceChunk - 1) / resourceChunk;
+	int chunks = chunkCols * chunkRows;
+	long long area = (long long)width * height;
+	std::vector<long long> missing((size_t)chunks * resourceKinds, 0);
+
+	auto fillChunk = [&](int chunk) {
+		int x0 = chunk % chunkCols * resourceChunk, y0 = chunk / chunkCols * resourceChunk;
+		int w = std::min(resourceChunk, width - x0), h = std::min(resourceChunk, height - y0);
+		// Chunks cover the map row by row, so the area before this one gives its share of each count.
+		long long before = (long long)y0 * width + (long long)h * x0, after = before + (long long)w * h;
+		uint32_t state = Mix(seed ^ Mix(chunk + 1)) | 1;
+		auto next = [&](uint32_t range) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (uint32_t)((uint64_t)state * range >> 32);
+		};
+		auto tryPlace = [&](int x, int y, int resourceId) {
+			if (ResourceAt(x, y) != 0 || !IsFreeAround(x, y)) return false;
+			tiles[PosToIndex(x, y)] = resourceId;
+			return true;
+		};
+		for (int k = 0; k < resourceKinds; k++) {
+			long long need = counts[k] * after / area - counts[k] * before / area;
+			for (long long darts = need * 8; need > 0 && darts > 0; darts--)
+				need -= tryPlace(x0 + next(w), y0 + next(h), k + 1);
+			for (int i = 0, start = next(w * h); need > 0 && i < w * h; i++) {
+				int t = (start + i) % (w * h);
+				need -= tryPlace(x0 + t % w, y0 + t / w, k + 1);
+			}
+			missing[(size_t)chunk * resourceKinds + k] = need;
+		}
+	};
+
+	unsigned threads = area >= parallelGenerationArea ? std::max(1u, std::thread::hardware_concurrency()) : 1;
+	std::vector<int> pass;
+	for (int parity = 0; parity < 4; parity++) {
+		pass.clear();
+		for (int chunk = 0; chunk < chunks; chunk++)
+			if ((chunk % chunkCols & 1) == (parity & 1) && (chunk / chunkCols & 1) == parity >> 1) pass.push_back(chunk);
+		std::atomic<size_t> taken{0};
+		auto work = [&] {
+			for (size_t i; (i = taken++) < pass.size();) fillChunk(pass[i]);
+		};
+		std::vector<std::thread> workers;
+		for (unsigned t = 1; t < std::min<size_t>(threads, pass.size()); t++) workers.emplace_back(work);
+		work();
+		for (auto &worker : workers) worker.join();
+	}
+
+	uint32_t state = Mix(seed) | 1;
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	long long start = (long long)((uint64_t)state * area >> 32);
+	for (int k = 0; k < resourceKinds; k++) {
+		long long need = 0;
+		for (int chunk = 0; chunk < chunks; chunk++) need += missing[(size_t)chunk * resourceKinds + k];
+		for (long long i = 0; need > 0 && i < area; i++) {
+			long long t = (start + i) % area;
+			int x = t % width, y = t / width;
+			if (ResourceAt(x, y) != 0 || !IsFreeAround(x, y)) continue;
+			tiles[t] = k + 1;
+			need--;
+		}
+	}
+}
+
+void World::Serialize(std::vector<unsigned char> &out) const {
+	out.assign(saveMagic, saveMagic + 4);
+	Put<uint32_t>(out, saveVersion);
+	Put<int32_t>(out, width);
+	Put<int32_t>(out, height);
+	out.insert(out.end(), tiles.begin(), tiles.end());
+	Put<float>(out, gameTime);
+	Put<float>(out, timeOfDay);
+	Put<float>(out, timer);
+	Put<float>(out, timeSpeed);
+	Put<int32_t>(out, gold);
+	Put<int32_t>(out, tree);
+	Put<int32_t>(out, iron);
+	Put<int32_t>(out, ammoCore);
+	Put<uint32_t>(out, index.buildings.size());
+	for (auto &b : index.buildings) {
+		Put<uint8_t>(out, b.type);
+		Put<int32_t>(out, b.x);
+		Put<int32_t>(out, b.y);
+		Put<int32_t>(out, CannonAmmo(b.x, b.y));
+	}
+	Put<int32_t>(out, baseHealth);
+	Put<int32_t>(out, wave);
+	Put<uint8_t>(out, nightActive);
+	Put<float>(out, spawnBudget);
+	Put<uint32_t>(out, waveRandom);
+	Put<uint8_t>(out, targetPolicy);
+	Put<uint32_t>(out, enemies.Count());
+	for (size_t i = 0; i < enemies.Count(); i++) {
+		Put<float>(out, enemies.x[i]);
+		Put<float>(out, enemies.y[i]);
+		Put<float>(out, enemies.health[i]);
+		Put<float>(out, enemies.speed[i]);
+		Put<float>(out, enemies.damage[i]);
+	}
+	// In launch order, which decides the order they land in; loading launches them again in that order.
+	std::vector<int> shots;
+	projectiles.InOrder(shots);
+	Put<uint32_t>(out, shots.size());
+	for (int i : shots) {
+		Put<uint8_t>(out, projectiles.kind[i]);
+		Put<float>(out, projectiles.x[i]);
+		Put<float>(out, projectiles.y[i]);
+		Put<float>(out, projectiles.vx[i]);
+		Put<float>(out, projectiles.vy[i]);
+		Put<float>(out, projectiles.timeLeft[i]);
+	}
+	// In building order, which loading keeps, rather than economy list order, which it does not.
+	for (EconomyKind kind : {ECON_ARCHER, ECON_CANNON}) {
+		const EconomyList &towers = economy[kind];
+		Put<uint32_t>(out, towers.tile.size());
+		for (size_t i = 0; i < index.buildings.size(); i++) {
+			if (EconomyKindOf(index.buildings[i].type) != kind) continue;
+			Put<int32_t>(out, towers.tile[index.kindSlot[i]]);
+			Put<float>(out, towers.cooldown[index.kindSlot[i]]);
+		}
+	}
+	Put<uint32_t>(out, stocks.size());
+	for (const BaseStock &stock : stocks) {
+		Put<int32_t>(out, stock.tile);
+		Put<int32_t>(out, stock.gold);
+		Put<int32_t>(out, stock.tree);
+		Put<int32_t>(out, stock.iron);
+		Put<int32_t>(out, stock.ammoCore);
+	}
+}
+
+bool World::Deserialize(const std::vector<unsigned char> &in) {
+	size_t pos = 4;
+	uint32_t version;
+	int32_t savedWidth, savedHeight;
+	if (in.size() < 4 || memcmp(in.data(), saveMagic, 4) != 0) return false;
+	// Version 1 saves predate enemies and load with none.
+	if (!Get(in, pos, version) || version < 1 || version > saveVersion) return false;
+	if (!Get(in, pos, savedWidth) || !Get(in, pos, savedHeight) || savedWidth <= 0 || savedHeight <= 0) return false;
+	if (savedWidth > maxMapSide || savedHeight > maxMapSide) return false;
+	if (pos + (size_t)savedWidth * savedHeight > in.size()) return false;
+	Resize(savedWidth, savedHeight);
+	tiles.assign(in.begin() + pos, in.begin() + pos + tiles.size());
+	pos += tiles.size();
+	float savedTime, savedTimeOfDay, savedTimer, savedSpeed;
+	int32_t savedGold, savedTree, savedIron, savedAmmoCore;
+	uint32_t count;
+	if (!Get(in, pos, savedTime) || !Get(in, pos, savedTimeOfDay) || !Get(in, pos, savedTimer) || !Get(in, pos, savedSpeed))
+		return false;
+	if (!(savedSpeed >= 0.0f && savedSpeed <= maxTimeSpeed)) return false;
+	if (!Get(in, pos, savedGold) || !Get(in, pos, savedTree) || !Get(in, pos, savedIron) || !Get(in, pos, savedAmmoCore))
+		return false;
+	if (!Get(in, pos, count)) return false;
+	Clear();
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t type;
+		int32_t x, y, ammo;
+		if (!Get(in, pos, type) || !Get(in, pos, x) || !Get(in, pos, y) || !Get(in, pos, ammo)) return false;
+		if (type <= BUILD_NONE || type > BUILD_CANNON || !IsInsideMap(x, y) || BuildingAt(x, y)) continue;
+		InsertBuilding((BuildingType)type, x, y);
+		if (type == BUILD_CANNON) economy[ECON_CANNON].ammo[index.kindSlot.back()] = ammo;
+	}
+	FinishBuildChanges();
+	if (version >= 2) {
+		int32_t savedHealth, savedWave;
+		uint8_t savedNight;
+		uint32_t enemyCount;
+		if (!Get(in, pos, savedHealth) || !Get(in, pos, savedWave) || !Get(in, pos, savedNight)) return false;
+		if (!Get(in, pos, spawnBudget) || !Get(in, pos, waveRandom)) return false;
+		uint8_t policy = TARGET_NEAREST;
+		if (version >= 3 && (!Get(in, pos, policy) || policy >= TARGET_POLICIES)) return false;
+		if (!Get(in, pos, enemyCount)) return false;
+		targetPolicy = (TargetPolicy)policy;
+		baseHealth = savedHealth;
+		wave = savedWave;
+		nightActive = savedNight != 0;
+		for (uint32_t i = 0; i < enemyCount; i++) {
+			float x, y, hp, tilesPerHour, hits;
+			if (!Get(in, pos, x) || !Get(in, pos, y) || !Get(in, pos, hp) || !Get(in, pos, tilesPerHour) || !Get(in, pos, hits))
+				return false;
+			enemies.Spawn(x, y, hp, tilesPerHour, hits);
+		}
+	}
+	// Shots in flight are saved from version 4 on; they load into the bottom of the pool in launch order.
+	uint32_t projectileCount = 0;
+	if (version >= 4 && (!Get(in, pos, projectileCount) || projectileCount > (uint32_t)maxProjectiles)) return false;
+	for (uint32_t i = 0; i < projectileCount; i++) {
+		uint8_t kind;
+		float x, y, vx, vy, left;
+		if (!Get(in, pos, kind) || !Get(in, pos, x) || !Get(in, pos, y) || !Get(in, pos, vx) || !Get(in, pos, vy) ||
+			!Get(in, pos, left) || kind >= PROJECTILE_KINDS)
+			return false;
+		int slot = projectiles.Spawn((ProjectileKind)kind, x, y, x, y, 1.0f);
+		projectiles.vx[slot] = vx;
+		projectiles.vy[slot] = vy;
+		projectiles.timeLeft[slot] = left;
+	}
+	// So are tower cooldowns, keyed by tile.
+	for (EconomyKind kind : {ECON_ARCHER, ECON_CANNON}) {
+		uint32_t towerCount = 0;
+		if (version >= 4 && !Get(in, pos, towerCount)) return false;
+		for (uint32_t i = 0; i < towerCount; i++) {
+			int32_t tile;
+			float cooldown;
+			if (!Get(in, pos, tile) || !Get(in, pos, cooldown)) return false;
+			if (tile < 0 || tile >= (int32_t)tiles.size()) continue;
+			EconomyList &towers = economy[kind];
+			int slot = index.occupancy[tile] < 0 ? -1 : index.kindSlot[index.occupancy[tile]];
+			if (slot >= 0 && slot < (int)towers.tile.size() && towers.tile[slot] == tile) towers.cooldown[slot] = cooldown;
+		}
+	}
+	// Each base's stock from version 5 on, in placement order, which decides where joined networks pool
+	// theirs. Older saves had one shared stock, which goes to the first base.
+	if (version < 5 && !stocks.empty()) stocks[0] = {stocks[0].tile, savedGold, savedTree, savedIron, savedAmmoCore};
+	uint32_t stockCount = 0;
+	if (version >= 5 && !Get(in, pos, stockCount)) return false;
+	std::vector<BaseStock> loaded;
+	for (uint32_t i = 0; i < stockCount; i++) {
+		BaseStock saved;
+		if (!Get(in, pos, saved.tile) || !Get(in, pos, saved.gold) || !Get(in, pos, saved.tree) || !Get(in, pos, saved.iron) ||
+			!Get(in, pos, saved.ammoCore))
+			return false;
+		auto base = std::find_if(stocks.begin(), stocks.end(), [&](const BaseStock &stock) { return stock.tile == saved.tile; });
+		if (base == stocks.end()) continue;
+		loaded.push_back(saved);
+		stocks.erase(base);
+	}
+	if (version >= 5) {
+		loaded.insert(loaded.end(), stocks.begin(), stocks.end());
+		stocks = std::move(loaded);
+	}
+	gameTime = savedTime;
+	timeOfDay = savedTimeOfDay;
+	timer = savedTimer;
+	timeSpeed = savedSpeed;
+	SumStocks();
+	saveDirty = false;
+	return true;
+}
+
+uint64_t World::StateHash() const {
+	std::vector<unsigned char> state;
+	Serialize(state);
+	uint64_t hash = 14695981039346656037ull;
+	for (unsigned char c : state) hash = (hash ^ c) * 1099511628211ull;
+	return hash;
+}
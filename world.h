@@ -0,0 +1,377 @@
+#pragma once
+#include "enemies.h"
+#include "flowfield.h"
+#include "projectiles.h"
+#include "logistics.h"
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+
+// Game simulation. Nothing in here depends on raylib, so it also runs in the headless build.
+
+const int defaultMapWidth = 40, defaultMapHeight = 40;
+const int maxMapSide = 16384;
+const int linkRange = 5;
+const int maxHops = 5;
+// Goods a link between two bases or transporters carries per game hour, all kinds together.
+const int linkCapacity = 20;
+
+enum BuildingType {
+	BUILD_NONE,
+	BUILD_BASE,
+	BUILD_GOLD_MINE,
+	BUILD_TRANSPORTER,
+	BUILD_SAWMILL,
+	BUILD_ARCHER,
+	BUILD_IRON_MINE,
+	BUILD_FACTORY,
+	BUILD_CANNON,
+};
+
+// One byte per tile: the low bits hold the resource (0 none, 1 tree, 2 gold, 3 iron), the rest is free for flags.
+typedef uint8_t Tile;
+const Tile tileResourceMask = 0x07;
+const int resourceKinds = 3;
+
+struct Building { BuildingType type; int x, y; };
+
+// How a tile shows on overview maps: empty, an unpowered or a powered building, or a base.
+enum TileMark : uint8_t { MARK_NONE, MARK_UNPOWERED, MARK_POWERED, MARK_BASE, MARK_KINDS };
+// A tile changing mark, logged so views can follow the map change by change instead of redrawing it.
+struct MarkChange { int tile; TileMark from, to; };
+const int maxMarkChanges = 1 << 16;
+
+// Buildings as dense parallel arrays, one entry per building, kept compact with swap-remove: position and
+// type, whether it is powered, its slot in the economy list of its kind (-1 if it has none), and the
+// logistics group and (bases and transporters only) network it was last solved in (-1 for none). Code that
+// refers to a building across ticks keeps its tile, which stays put for as long as the building stands.
+// Buildings are looked up by tile through `occupancy` and by range through a coarse grid of buckets; both
+// hold dense positions.
+const int bucketSize = 8;
+
+struct BuildingIndex {
+	std::vector<Building> buildings;
+	std::vector<unsigned char> powered;
+	std::vector<int> kindSlot;
+	std::vector<int> group, network;
+	std::vector<int> occupancy;
+	std::vector<std::vector<int>> buckets;
+	int width = 0, height = 0;
+	int bucketCols = 0;
+
+	void Reset(int mapWidth, int mapHeight);
+	void Add(BuildingType type, int x, int y);
+	void Remove(int x, int y);
+
+	const Building *At(int x, int y) const {
+		int i = occupancy[y * width + x];
+		return i < 0 ? nullptr : &buildings[i];
+	}
+
+	// Calls fn for every building within Manhattan distance `range` of (x, y), including one standing on (x, y).
+	template <typename Fn>
+	void ForEachInRange(int x, int y, int range, Fn fn) const {
+		int bx0 = std::max(0, x - range) / bucketSize, bx1 = std::min(width - 1, x + range) / bucketSize;
+		int by0 = std::max(0, y - range) / bucketSize, by1 = std::min(height - 1, y + range) / bucketSize;
+		for (int by = by0; by <= by1; by++)
+			for (int bx = bx0; bx <= bx1; bx++)
+				for (int i : buckets[by * bucketCols + bx]) {
+					const Building &b = buildings[i];
+					if (abs(b.x - x) + abs(b.y - y) <= range) fn(b);
+				}
+	}
+
+private:
+	int BucketOf(int x, int y) const { return (y / bucketSize) * bucketCols + x / bucketSize; }
+};
+
+struct PowerNode {
+	int tile;
+	BuildingType type;
+	int hops;
+	std::vector<int> links;
+};
+
+// Power network kept up to date on placement and removal only. Bases and transporters carry a hop count
+// from the nearest base (a transporter more than maxHops away is unpowered), consumers are powered while
+// any linked transporter is.
+struct PowerGrid {
+	void Reset(int mapWidth, int mapHeight);
+	// Links a building that has already been added to `index`. Power spreads from it at the next Update(),
+	// so a batch of additions is propagated in one pass.
+	void Add(BuildingType type, int x, int y, const BuildingIndex &index);
+	void Update() { Relax(); }
+	void Remove(int x, int y);
+	// Removes the buildings on all of `tiles` with one re-seeding of the power they supported.
+	void Remove(const std::vector<int> &tiles);
+
+	bool IsPowered(int idx) const { return powered[idx] != 0; }
+
+	// Tiles whose powered state flipped since the last ClearChanged(); a tile may appear more than once.
+	const std::vector<int> &Changed() const { return changed; }
+	// Tiles of buildings added or removed, and of those that gained or lost a link, over the same period.
+	const std::vector<int> &Relinked() const { return relinked; }
+	void ClearChanged() {
+		changed.clear();
+		relinked.clear();
+	}
+
+	// Tile pairs of every link between two powered buildings, each listed once.
+	const std::vector<std::pair<int, int>> &Edges();
+
+	// Calls fn with the tile of every building linked to the one on `tile`, in tile order.
+	template <typename Fn>
+	void ForEachLink(int tile, Fn fn) const {
+		int id = nodeAt[tile];
+		if (id < 0) return;
+		for (int n : nodes[id].links) fn(nodes[n].tile);
+	}
+
+private:
+	int width = 0;
+	std::vector<int> nodeAt;
+	std::vector<unsigned char> powered;
+	std::vector<PowerNode> nodes;
+	std::vector<int> freeNodes;
+	std::vector<int> buckets[maxHops + 1];
+	std::vector<std::pair<int, int>> edges;
+	std::vector<int> changed, relinked;
+	bool edgesDirty = true;
+	// Scratch for Remove(): the removed buildings' former links, the relays they supported (with the hop
+	// count of the removed relay) and those cut off.
+	std::vector<int> single, formers, lost, stack;
+	std::vector<std::pair<int, int>> seeds;
+
+	void SetPowered(int tile, bool on);
+	void Offer(int id, int hops);
+	void RefreshConsumer(int id);
+	void Relax();
+};
+
+// Buildings that take part in the economy or combat tick, grouped by kind.
+enum EconomyKind { ECON_GOLD_MINE, ECON_SAWMILL, ECON_IRON_MINE, ECON_FACTORY, ECON_CANNON, ECON_ARCHER, ECON_KINDS };
+
+// Economy buildings of one kind as parallel arrays. Whether a mine is next to its resource is fixed at
+// placement; `network` is the network a building draws from, as of the last logistics solve (-1 for none).
+// Towers use `cooldown`, cannons also `ammo`.
+struct EconomyList {
+	std::vector<int> tile;
+	std::vector<unsigned char> nearResource;
+	std::vector<unsigned char> powered;
+	std::vector<int> network;
+	std::vector<int> ammo;
+	std::vector<float> cooldown;
+};
+
+// What one base holds. When networks join, their bases pool everything in the one placed first.
+struct BaseStock { int tile; int gold, tree, iron, ammoCore; };
+
+// A connected part of the powered network of bases and transporters: the stock it keeps, what its mines
+// get through to its bases per game hour within the link capacities, and how many factories it feeds.
+// An unused slot has stock -1.
+struct Network { int stock; int gold, tree, iron, factories; };
+
+// Networks whose goods can mix, because a mine links to more than one of them, and whose flow is solved as
+// one: the tiles of their powered bases, transporters and mines in tile order, the networks, and the flow
+// graph with the arcs from mines to bases and transporters. An unused group has no tiles.
+struct LogisticsGroup {
+	std::vector<int> tiles, networks, mineArcs;
+	FlowGraph graph;
+};
+
+// Player actions, applied through World::Apply so a session can be recorded and replayed (replay.h).
+enum CommandKind {
+	CMD_PLACE, CMD_REMOVE, CMD_SPEED, CMD_TARGET_POLICY, CMD_PLACE_AREA, CMD_REMOVE_AREA, CMD_UNDO, CMD_REDO,
+	COMMAND_KINDS
+};
+
+struct Command {
+	uint64_t tick;
+	CommandKind kind;
+	BuildingType type;
+	// Tile for place and remove, the policy for CMD_TARGET_POLICY. The area commands cover the rectangle
+	// between (x, y) and (toX, toY).
+	int x, y;
+	float speed;
+	int toX = 0, toY = 0;
+};
+
+// Largest rectangle one area command may cover, and how many player actions can be undone.
+const int maxAreaTiles = 1 << 16;
+const int maxUndoActions = 100;
+
+// Buildings one player action placed or removed, kept so the action can be undone and redone.
+struct BuildAction {
+	bool placed;
+	std::vector<Building> buildings;
+};
+
+const int goldMineRate = 5, sawmillRate = 2, ironMineRate = 1;
+const int cannonCapacity = 20;
+
+// Enemies attack in waves at night, from 23:00 until 6:00, walking from the map edge to the base.
+const float nightStart = 23.0f, nightEnd = 6.0f;
+const int baseMaxHealth = 1000;
+// Enemies path around resources and, if they can, buildings.
+const int openPathCost = 1, resourcePathCost = 4, buildingPathCost = 16;
+
+// Powered towers fire at an enemy in range every `interval` game hours. Shots fly at `projectileSpeed` tiles
+// per game hour toward where the target will be and hit the closest enemy within projectileHitRadius of
+// where they land. A cannon shot costs one ammo and also hits every other enemy within `splash` of it.
+struct TowerStats { float range, interval, damage, splash, splashDamage, projectileSpeed; };
+const TowerStats archerStats = {4.0f, 0.5f, 4.0f, 0.0f, 0.0f, 12.0f};
+const TowerStats cannonStats = {6.0f, 2.0f, 12.0f, 1.5f, 6.0f, 6.0f};
+const float projectileHitRadius = 0.75f;
+
+// Which enemy in range a tower picks: the closest, the weakest, or the one with the shortest path left.
+enum TargetPolicy { TARGET_NEAREST, TARGET_LOWEST_HEALTH, TARGET_FIRST, TARGET_POLICIES };
+
+// Longest stretch of game time simulated in one go while anything is moving, enough for 3x at the fixed
+// step rate. Faster speeds split each step into several of these; quiet stretches are skipped in one.
+const float maxGameStep = 0.05f;
+const float maxTimeSpeed = 1000.0f;
+// Loading a save runs the time the player was away, at the saved speed, up to this many game hours.
+const float maxCatchUpHours = 24.0f;
+
+struct World {
+	// Simulation runs in fixed steps of real time; timeSpeed scales how much game time each step covers.
+	static constexpr float fixedStep = 1.0f / 60.0f;
+	static constexpr int maxStepsPerUpdate = 8;
+
+	int width, height;
+	std::vector<Tile> tiles;
+	BuildingIndex index;
+	PowerGrid powerGrid;
+	EconomyList economy[ECON_KINDS];
+	Enemies enemies;
+	EnemyGrid enemyGrid;
+	Projectiles projectiles;
+	TargetPolicy targetPolicy = TARGET_NEAREST;
+	// Paths from every tile to the base, built when the base is placed.
+	FlowField flowField;
+	float gameTime = 8.0f;
+	float timeOfDay = 8.0f / 24.0f;
+	float timer = 0.0f;
+	float timeSpeed = 1.0f;
+	// Totals over `stocks`.
+	int gold = 0;
+	int tree = 0;
+	int iron = 0;
+	int ammoCore = 0;
+	// Every base keeps its own stock, in placement order. The first base is the one enemies march on.
+	std::vector<BaseStock> stocks;
+	// Kept from one economy tick to the next; only those in or next to changed buildings are worked out again.
+	std::vector<Network> networks;
+	bool basePlaced = false;
+	int baseX = -1, baseY = -1;
+	int baseHealth = baseMaxHealth;
+	// Number of the current or last night's wave, 0 before the first night.
+	int wave = 0;
+	bool saveDirty = false;
+	// Ticks run since the last new game or load; commands are recorded against this.
+	uint64_t ticks = 0;
+	uint32_t seed = 0;
+	// Bumped whenever buildings or the power network change, so copies of them can be refreshed lazily.
+	uint64_t revision = 0;
+	// Mark changes since the reader last cleared them. Past maxMarkChanges, or on a new map, the log is
+	// emptied and marksDropped set: a reader then has to look at every building again.
+	std::vector<MarkChange> markChanges;
+	bool marksDropped = false;
+
+	World(int mapWidth = defaultMapWidth, int mapHeight = defaultMapHeight);
+
+	// Changes the map dimensions, leaving an empty map without buildings.
+	void Resize(int mapWidth, int mapHeight);
+	// Generates a new map from `seed`; without one, a random seed is drawn.
+	void NewGame();
+	void NewGame(uint32_t seed);
+	// Advances by `dt` seconds of real time, running as many fixed steps as fit.
+	void Step(float dt);
+	void Tick(float dt);
+	// Runs `hours` of game time, split into as few steps as the state allows.
+	void Advance(float hours);
+	// Runs up to maxCatchUpHours of the time since the game was saved, `awaySeconds` of real time ago.
+	float CatchUp(double awaySeconds);
+
+	bool CanPlace(BuildingType type, int x, int y) const;
+	bool Place(BuildingType type, int x, int y);
+	bool Remove(int x, int y);
+	// Place or remove everything they can in the rectangle from (x0, y0) to (x1, y1) as one batch: the power
+	// network, economy lists and revision are updated once. Return how many buildings changed; bases are
+	// neither placed nor removed this way.
+	int PlaceArea(BuildingType type, int x0, int y0, int x1, int y1);
+	int RemoveArea(int x0, int y0, int x1, int y1);
+	// Applies a player command. Building commands can be undone and redone in order.
+	bool Apply(const Command &command);
+	bool Undo();
+	bool Redo();
+
+	bool IsInsideMap(int x, int y) const { return x >= 0 && x < width && y >= 0 && y < height; }
+	int PosToIndex(int x, int y) const { return y * width + x; }
+	int ResourceAt(int x, int y) const { return tiles[y * width + x] & tileResourceMask; }
+
+	const std::vector<Building> &Buildings() const { return index.buildings; }
+	const Building *BuildingAt(int x, int y) const { return index.At(x, y); }
+	bool IsPowered(int idx) const { return powerGrid.IsPowered(idx); }
+	int CannonAmmo(int x, int y) const;
+
+	void Serialize(std::vector<unsigned char> &out) const;
+	bool Deserialize(const std::vector<unsigned char> &in);
+	// FNV-1a over the serialized state, for comparing the end of a replay across builds.
+	uint64_t StateHash() const;
+
+private:
+	float accumulator = 0.0f;
+	bool nightActive = false;
+	float spawnBudget = 0.0f;
+	uint32_t waveRandom = 1;
+	// Logistics groups and the unused slots of groups and networks. Tiles whose buildings or links changed
+	// since the last solve: the groups of them and of the buildings linked to them are solved again.
+	std::vector<LogisticsGroup> groups;
+	std::vector<int> freeGroups, freeNetworks, logisticsChanged;
+	// Scratch for SolveLogistics().
+	std::vector<int> logisticsPool, logisticsStack, logisticsConsumers, newGroups, deadNetworks;
+	std::vector<int> nodeOf, joinedTo, rootNetwork;
+	std::vector<unsigned char> consumerQueued;
+	// Player actions, of which the first historyPos are done and the rest undone.
+	std::vector<BuildAction> history;
+	size_t historyPos = 0;
+
+	void Clear();
+	void AddBuilding(BuildingType type, int x, int y);
+	void RemoveBuilding(int x, int y);
+	// Insert and erase leave the power network to settle in FinishBuildChanges(), once per batch.
+	void InsertBuilding(BuildingType type, int x, int y);
+	void EraseBuilding(int x, int y);
+	void FinishBuildChanges();
+	// Place or remove whichever of `wanted` they can, listing what they did in `done`.
+	void PlaceAll(const std::vector<Building> &wanted, std::vector<Building> &done);
+	void RemoveAll(const std::vector<Building> &wanted, std::vector<Building> &done);
+	void RecordAction(bool placed, std::vector<Building> buildings);
+	bool AreaTiles(int &x0, int &y0, int &x1, int &y1) const;
+	void SyncPower();
+	void LogMark(int tile, TileMark from, TileMark to);
+	bool IsNextTo(int x, int y, int resourceId) const;
+	bool IsFreeAround(int x, int y) const;
+	// Scatters counts[k] tiles of resource k + 1 with no two resources next to each other, even diagonally.
+	void GenerateIsolatedResources(const long long (&counts)[resourceKinds]);
+	void GameStep(float dt);
+	float QuietTime() const;
+	void SolveLogistics();
+	bool IsLogisticsNode(int i) const;
+	void DissolveGroup(int g);
+	void QueueConsumer(int tile);
+	int NewNetwork();
+	void SolveGroup(int g);
+	void SumStocks();
+	void EconomyTick(int count);
+	void EnemyTick(float dt);
+	void SpawnEnemy();
+	void FireTowers(EconomyKind kind, const TowerStats &stats, float dt);
+	void ProjectileImpact(ProjectileKind kind, float x, float y);
+	int PickTarget(float x, float y, float range) const;
+	int PathCost(int x, int y) const;
+	float WaveRandom();
+};